@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+
+//Bump allocator for objects built and dropped together, such as the
+//PlugBoards and Plugs of one search batch or the EnigmaMessages parsed from
+//one chunk of a corpus. Release drops everything at once without running
+//destructors, so only put objects in it whose own allocations come from it:
+//Plugs, EncipheredText, Preamble and EnigmaMessage pick up the arena when
+//created here.
+//Not thread safe; use one arena per thread.
+class Arena
+{
+  std::unique_ptr<std::byte[]> initial_;
+  std::pmr::monotonic_buffer_resource resource_;
+public:
+  explicit Arena(size_t initialSize = 64*1024):
+    initial_{std::make_unique<std::byte[]>(initialSize)},
+    resource_{initial_.get(), initialSize}
+  {}
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  std::pmr::memory_resource* Resource()
+  {
+    return &resource_;
+  }
+
+  //Constructs with uses-allocator construction, so allocator aware types
+  //e.g. Plugs or EnigmaMessage allocate from the arena too
+  template <typename T, typename... TArgs>
+  T& Create(TArgs&&... args)
+  {
+    return *std::pmr::polymorphic_allocator<>{&resource_}.new_object<T>(std::forward<TArgs>(args)...);
+  }
+
+  //For the results of the static Create functions e.g. PlugBoard::Create
+  template <typename T>
+  T* Create(std::optional<T>&& value)
+  {
+    return value ? &Create<T>(std::move(*value)) : nullptr;
+  }
+
+  //Invalidates everything created; memory past the initial block goes back to the heap
+  void Release()
+  {
+    resource_.release();
+  }
+};
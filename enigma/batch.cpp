@@ -0,0 +1,132 @@
+#include "pch.h"
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "batch.h"
+
+namespace
+{
+  constexpr size_t c_linesPerChunk = 1024;
+
+  //Owned by the reader while Free, a worker while Read and the writer while Enciphered
+  struct Chunk
+  {
+    enum class State { Free, Read, Enciphered } state{State::Free};
+    size_t numLines{0};
+    std::vector<std::string> keys = std::vector<std::string>(c_linesPerChunk);
+    std::vector<std::string> lamps = std::vector<std::string>(c_linesPerChunk);
+  };
+}
+
+size_t EncipherLines(const Machine& machine,
+                     std::istream& in,
+                     std::ostream& out,
+                     size_t numThreads)
+{
+  numThreads = std::max<size_t>(numThreads, 1);
+
+  std::vector<Chunk> chunks(2*numThreads + 2);
+  std::mutex mutex;
+  std::condition_variable changed;
+  size_t numRead = 0; //Chunks
+  size_t numClaimed = 0;
+  bool endOfInput = false;
+
+  const auto chunkFor = [&chunks](size_t sequence) -> Chunk&
+  {
+    return chunks[sequence % chunks.size()];
+  };
+  const auto setState = [&](Chunk& chunk, Chunk::State state)
+  {
+    {
+      std::lock_guard lock{mutex};
+      chunk.state = state;
+    }
+    changed.notify_all();
+  };
+
+  std::thread reader{[&]
+  {
+    for (size_t sequence = 0; ; ++sequence)
+    {
+      auto& chunk = chunkFor(sequence);
+      {
+        std::unique_lock lock{mutex};
+        changed.wait(lock, [&chunk]{ return chunk.state == Chunk::State::Free; });
+      }
+
+      chunk.numLines = 0;
+      while (chunk.numLines != c_linesPerChunk && std::getline(in, chunk.keys[chunk.numLines]))
+      {
+        auto& keys = chunk.keys[chunk.numLines++];
+        if (!keys.empty() && keys.back() == '\r')
+          keys.pop_back();
+      }
+
+      {
+        std::lock_guard lock{mutex};
+        if (chunk.numLines)
+        {
+          chunk.state = Chunk::State::Read;
+          ++numRead;
+        }
+        endOfInput = chunk.numLines != c_linesPerChunk;
+      }
+      changed.notify_all();
+      if (endOfInput)
+        return;
+    }
+  }};
+
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i != numThreads; ++i)
+    workers.emplace_back([&]
+    {
+      auto m = machine;
+      for (;;)
+      {
+        Chunk* chunk = nullptr;
+        {
+          std::unique_lock lock{mutex};
+          changed.wait(lock, [&]{ return numClaimed != numRead || endOfInput; });
+          if (numClaimed == numRead)
+            return;
+          chunk = &chunkFor(numClaimed++);
+        }
+
+        for (size_t line = 0; line != chunk->numLines; ++line)
+        {
+          m = machine;
+          m.ToLamp(chunk->keys[line], chunk->lamps[line]);
+        }
+        setState(*chunk, Chunk::State::Enciphered);
+      }
+    });
+
+  size_t numLines = 0;
+  for (size_t sequence = 0; ; ++sequence)
+  {
+    auto& chunk = chunkFor(sequence);
+    {
+      std::unique_lock lock{mutex};
+      changed.wait(lock, [&]{ return chunk.state == Chunk::State::Enciphered || (endOfInput && sequence == numRead); });
+      if (chunk.state != Chunk::State::Enciphered)
+        break;
+    }
+
+    for (size_t line = 0; line != chunk.numLines; ++line)
+      out << chunk.lamps[line] << '\n';
+    numLines += chunk.numLines;
+    setState(chunk, Chunk::State::Free);
+  }
+  out.flush();
+
+  reader.join();
+  for (auto& worker: workers)
+    worker.join();
+
+  return numLines;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <istream>
+#include <ostream>
+
+#include "enigma.h"
+
+//Encipher each line of in, from the configured start of machine, writing one
+//line to out per line read and in the same order. Lines holding anything but
+//capital letters give an empty line.
+//Lines are read, enciphered on numThreads workers and written concurrently,
+//with a fixed set of line buffers recycled between them.
+//Returns the number of lines.
+size_t EncipherLines(const Machine& machine,
+                     std::istream& in,
+                     std::ostream& out,
+                     size_t numThreads);
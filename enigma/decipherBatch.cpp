@@ -0,0 +1,135 @@
+#include "pch.h"
+#include <algorithm>
+#include <atomic>
+#include <latch>
+#include <memory>
+#include <numeric>
+#include "decipherBatch.h"
+#include "keystream.h"
+#include "metrics.h"
+
+namespace
+{
+  //Wheel, ring setting and start position of each rotor, 13 bits a rotor
+  uint64_t GroupKey(const MachineSettings& key)
+  {
+    uint64_t groupKey = 0;
+    for (const auto& selection: key.selections)
+      groupKey = (groupKey << 13) | (selection.wheelIndex.Index() << 10)
+                                  | (selection.ringSetting.Index() << 5)
+                                  | selection.position.Index();
+    return groupKey;
+  }
+
+  //Items first to last share their rotor settings, sorted by message
+  void DecipherGroup(const Machine& machine,
+                     const std::vector<std::string>& messages,
+                     const std::vector<DecipherItem>& items,
+                     const size_t* first,
+                     const size_t* last,
+                     std::vector<std::string>& lamps)
+  {
+    auto configured = machine;
+    configured.Configure(items[*first].key.selections, PlugBoard::Create());
+
+    size_t numLetters = 0;
+    size_t longest = 0;
+    for (auto item = first; item != last; ++item)
+    {
+      numLetters += messages[items[*item].message].size();
+      longest = std::max(longest, messages[items[*item].message].size());
+    }
+
+    //A permutation costs a Map for each of the letters, so only worth making
+    //when the group has more letters to decipher than that
+    if (numLetters > c_numChars*longest)
+    {
+      Keystream keystream{configured, longest};
+      for (auto item = first; item != last; ++item)
+      {
+        const auto& [message, key] = items[*item];
+        const auto plugBoard = PlugBoard::Create(key.plugs);
+        if (!plugBoard)
+          continue;
+
+        auto& lamps_ = lamps[*item];
+        lamps_.reserve(messages[message].size());
+        auto cursor = keystream.From(0);
+        for (const auto key_: messages[message])
+        {
+          const auto key = Key::Create(key_);
+          if (!key)
+          {
+            lamps_.clear();
+            break;
+          }
+          lamps_ += plugBoard->Transform((*cursor++)[plugBoard->Transform(*key).Index()]).Value();
+        }
+        ENIGMA_COUNT(Keystrokes, lamps_.size());
+      }
+      return;
+    }
+
+    auto m = configured;
+    for (auto item = first; item != last; ++item)
+    {
+      const auto& [message, key] = items[*item];
+      const auto plugBoard = PlugBoard::Create(key.plugs);
+      if (!plugBoard)
+        continue;
+      m = configured;
+      m.Configure(*plugBoard);
+      m.ToLamp(messages[message], lamps[*item]);
+    }
+  }
+}
+
+std::vector<std::string> DecipherBatch(const Machine& machine,
+                                       const std::vector<std::string>& messages,
+                                       const std::vector<DecipherItem>& items,
+                                       PriorityThreadPool& pool,
+                                       Priority priority)
+{
+  std::vector<std::string> lamps(items.size());
+
+  std::vector<uint64_t> groupKeys(items.size());
+  std::transform(items.cbegin(), items.cend(), groupKeys.begin(), [](const auto& item){ return GroupKey(item.key); });
+
+  //Groups in wheel order then ring settings and positions, messages together within each
+  std::vector<size_t> order(items.size());
+  std::iota(order.begin(), order.end(), size_t{0});
+  std::sort(order.begin(), order.end(), [&](size_t lhs, size_t rhs)
+  {
+    return std::tie(groupKeys[lhs], items[lhs].message, lhs) < std::tie(groupKeys[rhs], items[rhs].message, rhs);
+  });
+
+  std::vector<std::pair<const size_t*, const size_t*>> groups;
+  for (auto first = order.data(), end = order.data() + order.size(); first != end;)
+  {
+    const auto last = std::find_if(first, end, [&](size_t item){ return groupKeys[item] != groupKeys[*first]; });
+    groups.emplace_back(first, last);
+    first = last;
+  }
+
+  //The caller deciphers groups too, taking them from the same counter as the
+  //pool, so the batch finishes even when called from one of the pool's own
+  //threads. A task left queued after the batch finishes only touches the
+  //shared counter, and finds no group left.
+  const auto numGroups = groups.size();
+  const auto nextGroup = std::make_shared<std::atomic<size_t>>(0);
+  std::latch done{static_cast<std::ptrdiff_t>(numGroups)};
+  const auto decipherGroups = [&, numGroups, nextGroup]
+  {
+    for (size_t group; (group = (*nextGroup)++) < numGroups;)
+    {
+      DecipherGroup(machine, messages, items, groups[group].first, groups[group].second, lamps);
+      done.count_down();
+    }
+  };
+  for (size_t task = 1; task < numGroups; ++task)
+    pool.Submit(priority, decipherGroups);
+  decipherGroups();
+  done.wait();
+
+  return lamps;
+}
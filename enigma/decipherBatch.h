@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "settings.h"
+#include "threadPool.h"
+
+//A candidate key to try on one of a day's messages
+struct DecipherItem
+{
+  size_t message; //Index into the messages
+  MachineSettings key;
+};
+
+//Deciphers every item, returning the lamps in item order; empty for bad plugs
+//or text that isn't all capital letters.
+//Items are grouped by wheels, ring settings and start positions, so the
+//rotors are configured once a group, and the groups are shared between pool
+//and the calling thread, so it can be called from a task on pool. Within a
+//group the items of a message run together, and a group with enough letters
+//shares one Keystream between all its messages and plugs.
+std::vector<std::string> DecipherBatch(const Machine& machine,
+                                       const std::vector<std::string>& messages,
+                                       const std::vector<DecipherItem>& items,
+                                       PriorityThreadPool& pool,
+                                       Priority priority = Priority::Batch);
@@ -3,6 +3,36 @@
 #include <numeric>
 #include "enigma.h"
 #include "framework.h"
+#include "metrics.h"
+
+Preamble::Preamble(const allocator_type& allocator):
+  to{allocator}
+{
+}
+
+Preamble::Preamble(const Preamble& other, const allocator_type& allocator):
+  from{other.from},
+  to{other.to, allocator},
+  timeOfOrigin{other.timeOfOrigin},
+  part{other.part},
+  numParts{other.numParts},
+  discriminant{other.discriminant},
+  indicatorSetting{other.indicatorSetting}
+{
+}
+
+EnigmaMessage::EnigmaMessage(const allocator_type& allocator):
+  preamble{allocator},
+  encipheredText{allocator}
+{
+}
+
+EnigmaMessage::EnigmaMessage(const EnigmaMessage& other, const allocator_type& allocator):
+  interception{other.interception},
+  preamble{other.preamble, allocator},
+  encipheredText{other.encipheredText, allocator}
+{
+}
 
 bool operator==(const LeftTerminal& left1, const LeftTerminal& left2)
 {
@@ -28,11 +58,17 @@ RightTerminal RightTerminal::operator-(int inc) const
 Connections::Connections(std::array<LeftTerminal, c_numChars> rightToLeft):
   rightToLeft_{std::move(rightToLeft)}
 {
+  for (unsigned char right = 0; right != c_numChars; ++right)
+    leftToRight_[rightToLeft_[right].terminal.Index()] = RightTerminal{*Terminal::Create(right)};
 }
 
 /*static*/ std::optional<Connections> Connections::Create(std::array<LeftTerminal, c_numChars> rightToLeft)
 {
-  return all_unique(rightToLeft.cbegin(), rightToLeft.cend())
+  //Unique if every terminal is reached, as there are as many connections as terminals
+  uint32_t lefts = 0;
+  for (const auto& left: rightToLeft)
+    lefts |= uint32_t{1} << left.terminal.Index();
+  return lefts == (uint32_t{1} << c_numChars) - 1
        ? Connections{std::move(rightToLeft)}
        : std::optional<Connections>{};
 }
@@ -52,9 +88,7 @@ LeftTerminal Connections::ToLeft(RightTerminal right) const
 
 RightTerminal Connections::ToRight(LeftTerminal left) const
 {
-  const auto left_itr = std::find(rightToLeft_.cbegin(), rightToLeft_.cend(), left);
-  const auto left_idx = std::distance(rightToLeft_.cbegin(), left_itr);
-  return RightTerminal{*Terminal::Create(static_cast<unsigned char>(left_idx))};
+  return leftToRight_[left.terminal.Value()];
 }
 
 CrossConnection::CrossConnection():
@@ -121,9 +155,15 @@ LeftTerminal CrossConnections::Transform(LeftTerminal left) const
   return rightToLeft_[left.terminal.Value()];
 }
 
-Wheel::Wheel(const Connections& connections):
-  connections_{connections}
+Wheel::Wheel(const Connections& connections, Key turnover):
+  connections_{connections},
+  turnover_{turnover}
+{
+}
+
+Key Wheel::Turnover() const
 {
+  return turnover_;
 }
 
 LeftTerminal Wheel::ToLeft(RightTerminal right) const
@@ -138,37 +178,51 @@ RightTerminal Wheel::ToRight(LeftTerminal left) const
   return right;
 }
 
-Rotor::Rotor(const Wheel& wheel, Key ringSetting):
+Rotor::Rotor(const Wheel& wheel, Key ringSetting, Key position):
   wheel_{wheel},
-  rotation_{ringSetting.Index()}
+  ringSetting_{ringSetting.Index()},
+  position_{position.Index()}
 {
 }
 
+//The wiring turns with the position but the ring setting turns it back
 size_t Rotor::TotalRotation_() const
 {
-  return rotation_;
+  return (position_ + c_numChars - ringSetting_) % c_numChars;
 }
 
 LeftTerminal Rotor::ToLeft(RightTerminal right) const
 {
-  const auto effective_right = right - static_cast<int>(rotation_);
-  const auto effective_left = wheel_.get().ToLeft(effective_right);
-  const auto left = effective_left + static_cast<int>(rotation_);
+  const auto rotation = static_cast<int>(TotalRotation_());
+  const auto effective_right = right + rotation;
+  const auto effective_left = wheel_.ToLeft(effective_right);
+  const auto left = effective_left - rotation;
   return left;
 }
 
 RightTerminal Rotor::ToRight(LeftTerminal left) const
 {
-  const auto effective_left = left - static_cast<int>(rotation_);
-  const auto effective_right = wheel_.get().ToRight(effective_left);
-  const auto right = effective_right + static_cast<int>(rotation_);
+  const auto rotation = static_cast<int>(TotalRotation_());
+  const auto effective_left = left + rotation;
+  const auto effective_right = wheel_.ToRight(effective_left);
+  const auto right = effective_right - rotation;
   return right;
 }
 
-size_t Rotor::Inc(size_t inc) //Returns the increment for the next wheel
+size_t Rotor::Inc(size_t inc) //Returns 1 if it wrapped round
 {
-  rotation_ = (rotation_ + inc) % c_numChars;
-  return rotation_ ? 0 : 1;
+  position_ = (position_ + inc) % c_numChars;
+  return position_ ? 0 : 1;
+}
+
+bool Rotor::AtTurnover() const
+{
+  return position_ == wheel_.Turnover().Index();
+}
+
+Key Rotor::Position() const
+{
+  return Key{} + static_cast<int>(position_);
 }
 
 TurnAboutWheel::TurnAboutWheel(CrossConnections crossConnections):
@@ -203,18 +257,40 @@ Scrambler::Scrambler(TurnAboutWheel turnAroundWheel,
 void Scrambler::Configure(const std::array<Wheel,numMachineWheels>& wheels,
                           std::array<WheelSelection,numScramblerRotors> selections)
 {
-  rotors_ = {Rotor{wheels[selections[0].wheelIndex.Value()], selections[0].ringSetting},
-             Rotor{wheels[selections[1].wheelIndex.Value()], selections[1].ringSetting},
-             Rotor{wheels[selections[2].wheelIndex.Value()], selections[2].ringSetting}};
+  rotors_ = {Rotor{wheels[selections[0].wheelIndex.Value()], selections[0].ringSetting, selections[0].position},
+             Rotor{wheels[selections[1].wheelIndex.Value()], selections[1].ringSetting, selections[1].position},
+             Rotor{wheels[selections[2].wheelIndex.Value()], selections[2].ringSetting, selections[2].position}};
 }
 
-Lamp Scrambler::ToLamp(Key in)
+//Pawls: the right rotor always steps, carrying the middle one on from its
+//turnover, and the middle one steps itself and the left one from its own
+//turnover (the double step)
+void Scrambler::Step()
 {
-  for_while(rotors_.rbegin(), rotors_.rend(), [](auto& wheel)
+  auto& [left, middle, right] = rotors_;
+  if (middle.AtTurnover())
   {
-    return wheel.Inc(1);
-  });
+    left.Inc(1);
+    middle.Inc(1);
+  }
+  else if (right.AtTurnover())
+    middle.Inc(1);
+  right.Inc(1);
+}
+
+std::array<Key, numScramblerRotors> Scrambler::Positions() const
+{
+  return {rotors_[0].Position(), rotors_[1].Position(), rotors_[2].Position()};
+}
 
+Lamp Scrambler::ToLamp(Key in)
+{
+  Step();
+  return Map(in);
+}
+
+Lamp Scrambler::Map(Key in) const
+{
   auto terminal = commutator_.ToTerminal(in);
 
   terminal = std::accumulate(rotors_.crbegin(), rotors_.crend(),
@@ -235,71 +311,115 @@ Lamp Scrambler::ToLamp(Key in)
 }
 
 WheelSelection::WheelSelection(IntRange<unsigned char, 0, numMachineWheels> wheelIndex,
-                                 Key ringSetting):
+                                 Key ringSetting,
+                                 Key position):
   wheelIndex{wheelIndex},
-  ringSetting{ringSetting}
+  ringSetting{ringSetting},
+  position{position}
 {
 }
 
-std::optional<Connections> ToConnections(const Plugs& plugs)
+PlugBoard::PlugBoard()
 {
-  std::array<LeftTerminal, c_numChars> connections;
+  for (unsigned char key = 0; key != c_numChars; ++key)
+    keyToKey_[key] = Key{} + key;
+}
 
-  //Default plugs to identity connections
-  for (unsigned char terminal = 0; terminal != c_numChars; ++terminal)
-    connections[terminal] = LeftTerminal{*Terminal::Create(terminal)};
+/*static*/ std::optional<PlugBoard> PlugBoard::Create(const Plugs& plugs)
+{
+  ENIGMA_TIME(PlugBoardCreate);
+  ENIGMA_COUNT(PlugBoards, 1);
 
+  PlugBoard plugBoard;
   for (const auto& plug: plugs)
-  {
-    const auto lhs = static_cast<unsigned char>(plug.lhs.Index());
-    const auto rhs = static_cast<unsigned char>(plug.rhs.Index());
-    connections[lhs] = LeftTerminal{*Terminal::Create(rhs)};
-    connections[rhs] = LeftTerminal{*Terminal::Create(lhs)};
-  }
-  return Connections::Create(std::move(connections));
+    if (!plugBoard.Swap(plug.lhs, plug.rhs))
+      return {};
+
+  return plugBoard;
 }
 
-PlugBoard::PlugBoard(Connections connections):
-  connections_{std::move(connections)}
-{}
+/*static*/ PlugBoard PlugBoard::Create()
+{
+  return PlugBoard{};
+}
 
-/*static*/ std::optional<PlugBoard> PlugBoard::Create(const Plugs& plugs)
+Key PlugBoard::Transform(Key key) const
 {
-  if (auto connections = ToConnections(plugs))
-    return PlugBoard(std::move(*connections));
+  return keyToKey_[key.Index()];
+}
 
-  return {};
+bool PlugBoard::IsPlugged(Key key) const
+{
+  return plugged_ & (uint32_t{1} << key.Index());
 }
-Key PlugBoard::Transform(Key key) const
+
+bool PlugBoard::Swap(Key lhs, Key rhs)
 {
-  const auto terminalIn = RightTerminal{*Terminal::Create(key.Index())};
-  const auto terminalOut = connections_.ToLeft(terminalIn);
+  const auto ends = (uint32_t{1} << lhs.Index()) | (uint32_t{1} << rhs.Index());
+  if (lhs == rhs || (plugged_ & ends))
+    return false;
 
-  if (const auto keyOut = Key::Create(terminalOut.terminal.Value()))
-    return *keyOut;
+  keyToKey_[lhs.Index()] = rhs;
+  keyToKey_[rhs.Index()] = lhs;
+  plugged_ |= ends;
+  return true;
+}
 
-  throw;
+bool PlugBoard::Unswap(Key key)
+{
+  if (!IsPlugged(key))
+    return false;
+
+  const auto partner = keyToKey_[key.Index()];
+  keyToKey_[key.Index()] = key;
+  keyToKey_[partner.Index()] = partner;
+  plugged_ &= ~((uint32_t{1} << key.Index()) | (uint32_t{1} << partner.Index()));
+  return true;
 }
 
 Machine::Machine(TurnAboutWheel turnAboutWheel,
                  std::array<Wheel, numMachineWheels> wheels)
 : wheels_{std::move(wheels)},
   scrambler_{turnAboutWheel, wheels_},
-  plugBoard_{*PlugBoard::Create({})}
+  plugBoard_{PlugBoard::Create()}
 {
 }
 
 void Machine::Configure(std::array<WheelSelection, numScramblerRotors> selections,
                         PlugBoard plugBoard)
 {
+  ENIGMA_COUNT(Configures, 1);
+
   scrambler_.Configure(wheels_, selections);
   plugBoard_ = std::move(plugBoard);
 }
 
+void Machine::Configure(PlugBoard plugBoard)
+{
+  plugBoard_ = std::move(plugBoard);
+}
+
+//Not instrumented, as timing each letter would cost more than enciphering it
 Lamp Machine::ToLamp(const Key key_)
+{
+  Step();
+  return Map(key_);
+}
+
+void Machine::Step()
+{
+  scrambler_.Step();
+}
+
+std::array<Key, numScramblerRotors> Machine::Positions() const
+{
+  return scrambler_.Positions();
+}
+
+Lamp Machine::Map(const Key key_) const
 {
   const auto pluggedKey  = plugBoard_.Transform(key_);
-  const auto pluggedLamp = scrambler_.ToLamp(pluggedKey);
+  const auto pluggedLamp = scrambler_.Map(pluggedKey);
   const auto lamp        = plugBoard_.Transform(pluggedLamp);
   return lamp;
 }
@@ -307,14 +427,27 @@ Lamp Machine::ToLamp(const Key key_)
 std::string Machine::ToLamp(const std::string_view keys)
 {
   std::string lamps;
+  ToLamp(keys, lamps);
+  return lamps;
+}
+
+bool Machine::ToLamp(const std::string_view keys, std::string& lamps)
+{
+  ENIGMA_TIME(ToLamp);
+  lamps.clear();
 
   for (const auto key_: keys)
   {
     const auto key = Key::Create(key_);
     if (!key)
-      return {};
+    {
+      ENIGMA_COUNT(Keystrokes, lamps.size());
+      lamps.clear();
+      return false;
+    }
     lamps += ToLamp(*key).Value();
   }
 
-  return lamps;
+  ENIGMA_COUNT(Keystrokes, lamps.size());
+  return true;
 }
@@ -1,20 +1,25 @@
 #pragma once
 
 #include <array>
+#include <cstdint>
+#include <memory_resource>
 #include <optional>
 #include <string>
 #include <vector>
 
+#include "packedText.h"
+#include "smallVector.h"
 #include "util.h"
 
 static constexpr size_t c_numChars = 26;
 static_assert(c_numChars % 2 == 0); //Check even
+static_assert(c_numChars <= 32); //Sets of chars fit a uint32_t
 static constexpr size_t c_numCharsBy2 = c_numChars/2;
 
 using TextChar = IntRange<char, 'A', c_numChars>;
 using Key = TextChar;
 using Lamp = TextChar;
-using EncipheredText = std::vector<TextChar>;
+using EncipheredText = PackedText<TextChar>; //5 bits a letter
 
 using FrequencyHertz = float;
 using Time = size_t;
@@ -32,12 +37,22 @@ using IndicatorSetting = std::array<TextChar, 3>;
 struct Preamble
 {
   Callsign from{}; //Sending station
-  std::vector<Callsign> to; //Destination stations
+  SmallVector<Callsign, 2> to; //Destination stations, rarely more than two, so rarely a heap block
   Time timeOfOrigin{0};
   size_t part{0};
   size_t numParts{0};
   Discriminant discriminant{}; //Distinguish between different types of Enimga traffic. It indicates which of many current keys was being used
   IndicatorSetting indicatorSetting{}; //Used for encoding and decoding
+
+  //Allocator aware so callsigns beyond the inline two can live in an Arena
+  using allocator_type = decltype(to)::allocator_type;
+  Preamble() = default;
+  explicit Preamble(const allocator_type& allocator);
+  Preamble(const Preamble& other) = default;
+  Preamble(const Preamble& other, const allocator_type& allocator);
+  Preamble(Preamble&& other) noexcept = default;
+  Preamble& operator=(const Preamble& other) = default;
+  Preamble& operator=(Preamble&& other) = default;
 };
 
 struct EnigmaMessage
@@ -45,6 +60,16 @@ struct EnigmaMessage
   Interception interception;
   Preamble preamble;
   EncipheredText encipheredText;
+
+  //Allocator aware so an Arena can hold the text with the message
+  using allocator_type = EncipheredText::allocator_type;
+  EnigmaMessage() = default;
+  explicit EnigmaMessage(const allocator_type& allocator);
+  EnigmaMessage(const EnigmaMessage& other) = default;
+  EnigmaMessage(const EnigmaMessage& other, const allocator_type& allocator);
+  EnigmaMessage(EnigmaMessage&& other) noexcept = default;
+  EnigmaMessage& operator=(const EnigmaMessage& other) = default;
+  EnigmaMessage& operator=(EnigmaMessage&& other) = default;
 };
 
 using Terminal = IntRange<unsigned char, 0, c_numChars>;
@@ -68,6 +93,7 @@ class Connections
 {
 protected:
   std::array<LeftTerminal, c_numChars> rightToLeft_;
+  std::array<RightTerminal, c_numChars> leftToRight_; //Inverse, so ToRight is a lookup too
   Connections(std::array<LeftTerminal, c_numChars> rightToLeft);
 public:
   static std::optional<Connections> Create(std::array<LeftTerminal, c_numChars> rightToLefts);
@@ -101,24 +127,29 @@ public:
 
 class Wheel
 {
-  const Connections& connections_;
+  Connections connections_;
+  Key turnover_; //Position the wheel steps the next one on from
 public:
-  Wheel(const Connections& connections);
+  Wheel(const Connections& connections, Key turnover = Key{} + static_cast<int>(c_numChars - 1));
   LeftTerminal ToLeft(RightTerminal right) const;
   RightTerminal ToRight(LeftTerminal left) const;
+  Key Turnover() const;
 };
 
 class Rotor
 {
-  std::reference_wrapper<const Wheel> wheel_;
-  size_t rotation_{0};
+  Wheel wheel_;
+  size_t ringSetting_{0};
+  size_t position_{0}; //Letter showing in the window
 
   size_t TotalRotation_() const;
 public:
-  Rotor(const Wheel& wheel, Key ringSetting);
+  Rotor(const Wheel& wheel, Key ringSetting, Key position = Key{});
   LeftTerminal ToLeft(RightTerminal right) const;
   RightTerminal ToRight(LeftTerminal left) const;
   size_t Inc(size_t inc);
+  bool AtTurnover() const;
+  Key Position() const;
 };
 
 class TurnAboutWheel
@@ -144,8 +175,10 @@ struct WheelSelection
 {
   WheelIndex wheelIndex;
   Key ringSetting;
+  Key position; //Start position, the message key
   WheelSelection(WheelIndex wheelIndex,
-                 Key ringSetting);
+                 Key ringSetting,
+                 Key position = Key{});
 };
 
 class Scrambler
@@ -158,7 +191,10 @@ public:
             const std::array<Wheel,numMachineWheels>& wheels);
   void Configure(const std::array<Wheel,numMachineWheels>& wheels,
                  std::array<WheelSelection,numScramblerRotors> selections);
+  void Step();
+  Lamp Map(Key in) const; //Without stepping
   Lamp ToLamp(Key in);
+  std::array<Key, numScramblerRotors> Positions() const;
 };
 
 struct Plug
@@ -166,14 +202,21 @@ struct Plug
   Key lhs;
   Key rhs;
 };
-using Plugs = std::vector<Plug>;
+using Plugs = std::pmr::vector<Plug>;
+//Trivially copyable and changed in place, so a plug board search can try
+//millions of boards without building or allocating each
 class PlugBoard
 {
-  Connections connections_;
-  PlugBoard(Connections connections);
+  std::array<Key, c_numChars> keyToKey_; //Unplugged keys map to themselves
+  uint32_t plugged_{0}; //Bit per plugged key
+  PlugBoard();
 public:
-  static std::optional<PlugBoard> Create(const Plugs& plugs);
+  static std::optional<PlugBoard> Create(const Plugs& plugs); //Empty if a key has more than one plug
+  static PlugBoard Create(); //No plugs
   Key Transform(Key key) const;
+  bool IsPlugged(Key key) const;
+  bool Swap(Key lhs, Key rhs); //Plug lhs to rhs; false, leaving the board as was, if either is plugged or they're the same
+  bool Unswap(Key key); //Remove the plug from key and its partner; false if key is unplugged
 };
 class Machine
 {
@@ -186,6 +229,11 @@ public:
           std::array<Wheel, numMachineWheels> wheels);
   void Configure(std::array<WheelSelection, numScramblerRotors> selections,
                  PlugBoard plugBoard);
+  void Configure(PlugBoard plugBoard); //Leaving the rotors where they are
+  void Step();
+  Lamp Map(Key key) const; //Without stepping
   Lamp ToLamp(Key key);
+  std::array<Key, numScramblerRotors> Positions() const;
   std::string ToLamp(const std::string_view keys);
+  bool ToLamp(const std::string_view keys, std::string& lamps); //Reuses lamps' buffer
 };
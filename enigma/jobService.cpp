@@ -0,0 +1,219 @@
+#include "pch.h"
+#include <algorithm>
+#include "jobService.h"
+#include "metrics.h"
+#include "offsetSearch.h"
+#include "search.h"
+
+std::string_view ToString(JobState state)
+{
+  switch (state)
+  {
+  case JobState::Queued:    return "queued";
+  case JobState::Running:   return "running";
+  case JobState::Done:      return "done";
+  case JobState::Cancelled: return "cancelled";
+  case JobState::Failed:    return "failed";
+  }
+  return {};
+}
+
+JobService::JobService(Machine machine, size_t numThreads, size_t maxFinishedJobs):
+  machine_{std::move(machine)},
+  maxFinishedJobs_{std::max<size_t>(maxFinishedJobs, 1)},
+  pool_{numThreads}
+{
+}
+
+JobService::~JobService()
+{
+  CancelAll();
+}
+
+JobId JobService::Submit_(Priority priority, Work work)
+{
+  auto job = std::make_shared<Job>();
+
+  JobId id;
+  {
+    std::lock_guard lock{mutex_};
+    id = nextId_++;
+    jobs_.emplace(id, job);
+  }
+
+  pool_.Submit(priority, [this, id, job, work = std::move(work)]
+  {
+    //Recorded before the state is, so a finished job is always in finished_
+    const auto finish = [this, id]
+    {
+      std::lock_guard lock{mutex_};
+      finished_.push_back(id);
+      while (finished_.size() > maxFinishedJobs_)
+      {
+        jobs_.erase(finished_.front());
+        finished_.pop_front();
+      }
+    };
+
+    auto state = JobState::Queued;
+    if (!job->state.compare_exchange_strong(state, JobState::Running))
+      return finish(); //Cancelled while queued
+
+    auto result = work(job->cancelled);
+    if (result)
+      job->result = std::move(*result);
+    finish();
+    job->state = job->cancelled ? JobState::Cancelled
+               : result         ? JobState::Done
+                                : JobState::Failed;
+  });
+
+  return id;
+}
+
+JobId JobService::Encipher(MachineSettings settings, std::string text)
+{
+  return Submit_(Priority::Interactive,
+                 [this, settings = std::move(settings), text = std::move(text)](const auto&) -> std::optional<std::string>
+  {
+    auto machine = machine_;
+    if (!Configure(machine, settings))
+      return {};
+    auto lamps = machine.ToLamp(text);
+    if (lamps.size() != text.size())
+      return {};
+    return lamps;
+  });
+}
+
+JobId JobService::Search(Plugs plugs, std::string crib, std::string cipherText, SearchMode mode)
+{
+  return Submit_(Priority::Background,
+                 [this, plugs = std::move(plugs), crib = std::move(crib), cipherText = std::move(cipherText), mode](const auto& cancelled) -> std::optional<std::string>
+  {
+    std::string result;
+    const auto add = [&result](const std::string& hit)
+    {
+      if (!result.empty())
+        result += ';';
+      result += hit;
+    };
+    if (mode == SearchMode::Offsets)
+      for (const auto& hit: SearchCribByOffset(machine_, plugs, crib, cipherText, cancelled))
+        add(ToString(hit, plugs));
+    else
+      for (const auto& hit: SearchCrib(machine_, plugs, crib, cipherText, cancelled))
+        add(ToString(hit));
+    return result;
+  });
+}
+
+std::optional<JobStatus> JobService::Status(JobId id) const
+{
+  std::shared_ptr<Job> job;
+  {
+    std::lock_guard lock{mutex_};
+    const auto itr = jobs_.find(id);
+    if (itr == jobs_.end())
+      return {};
+    job = itr->second;
+  }
+
+  const JobState state = job->state;
+  if (state == JobState::Done || state == JobState::Cancelled)
+    return JobStatus{state, job->result};
+  return JobStatus{state, {}};
+}
+
+std::optional<JobState> JobService::Cancel(JobId id)
+{
+  std::shared_ptr<Job> job;
+  {
+    std::lock_guard lock{mutex_};
+    const auto itr = jobs_.find(id);
+    if (itr == jobs_.end())
+      return {};
+    job = itr->second;
+  }
+
+  job->cancelled = true;
+  auto state = JobState::Queued;
+  job->state.compare_exchange_strong(state, JobState::Cancelled);
+  return job->state.load();
+}
+
+void JobService::CancelAll()
+{
+  std::lock_guard lock{mutex_};
+  for (const auto& [id, job]: jobs_)
+  {
+    job->cancelled = true;
+    auto state = JobState::Queued;
+    job->state.compare_exchange_strong(state, JobState::Cancelled);
+  }
+}
+
+static std::optional<JobId> ToJobId(std::string_view text)
+{
+  JobId id = 0;
+  for (const auto c: text)
+  {
+    if (c < '0' || c > '9')
+      return {};
+    id = id*10 + static_cast<JobId>(c - '0');
+  }
+  return text.empty() ? std::optional<JobId>{} : id;
+}
+
+std::string JobService::Handle(std::string_view request)
+{
+  const auto words = split(request);
+  const auto command = words.empty() ? std::string_view{} : words.front();
+
+  const auto toReply = [](JobId id, JobState state)
+  {
+    return std::to_string(id) + ' ' + std::string{ToString(state)};
+  };
+
+  if ((command == "encipher" || command == "decipher") && (words.size() == 5 || words.size() == 6))
+  {
+    auto settings = words.size() == 6 ? ParseSettings(words[1], words[2], words[3], words[4])
+                                      : ParseSettings(words[1], words[2], words[3]);
+    if (settings)
+      return toReply(Encipher(std::move(*settings), std::string{words.back()}), JobState::Queued);
+    return "error bad settings";
+  }
+  if (command == "search" && (words.size() == 4 || words.size() == 5))
+  {
+    const auto mode = words.size() == 4 || words[4] == "rings" ? std::optional{SearchMode::RingSettings}
+                    : words[4] == "offsets"                    ? std::optional{SearchMode::Offsets}
+                                                               : std::nullopt;
+    if (!mode)
+      return "error unknown search mode";
+    if (auto plugs = ParsePlugs(words[1]))
+      return toReply(Search(std::move(*plugs), std::string{words[2]}, std::string{words[3]}, *mode), JobState::Queued);
+    return "error bad plugs";
+  }
+  if ((command == "status" || command == "cancel") && words.size() == 2)
+  {
+    const auto id = ToJobId(words[1]);
+    if (!id)
+      return "error bad job id";
+    if (command == "cancel")
+    {
+      if (const auto state = Cancel(*id))
+        return toReply(*id, *state);
+    }
+    else if (const auto status = Status(*id))
+    {
+      auto reply = toReply(*id, status->state);
+      if (!status->result.empty())
+        reply += ' ' + status->result;
+      return reply;
+    }
+    return "error unknown job";
+  }
+  if (command == "metrics" && words.size() == 1)
+    return ToJson(TakeMetricsSnapshot());
+  return "error unknown request";
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "settings.h"
+#include "threadPool.h"
+
+using JobId = size_t;
+
+enum class JobState : unsigned char
+{
+  Queued,
+  Running,
+  Done,
+  Cancelled,
+  Failed,
+};
+std::string_view ToString(JobState state);
+
+struct JobStatus
+{
+  JobState state;
+  std::string result;
+};
+
+enum class SearchMode : unsigned char
+{
+  RingSettings, //Every wheel order and ring setting, the rotors starting at AAA
+  Offsets,      //Start positions as well, each hit with how many keys share its keystream
+};
+
+//Long lived service that keeps the wheel wiring of one machine in memory and
+//runs encipher, decipher and search jobs on a PriorityThreadPool.
+//Requests are single lines:
+//  encipher <wheels> <rings> [<positions>] <plugs> <text>  -> <id> queued
+//  decipher <wheels> <rings> [<positions>] <plugs> <text>  -> <id> queued
+//  search <plugs> <crib> <cipherText> [rings|offsets]      -> <id> queued
+//  status <id>                                             -> <id> <state> [<result>]
+//  cancel <id>                                             -> <id> <state>
+//  metrics                                                 -> JSON from TakeMetricsSnapshot
+//Only the latest maxFinishedJobs finished jobs are kept for status requests.
+class JobService
+{
+  struct Job
+  {
+    std::atomic<JobState> state{JobState::Queued};
+    std::atomic<bool> cancelled{false};
+    std::string result; //Only read once state is Done or Cancelled
+  };
+  using Work = std::function<std::optional<std::string>(const std::atomic<bool>& cancelled)>;
+
+  const Machine machine_;
+  mutable std::mutex mutex_;
+  std::map<JobId, std::shared_ptr<Job>> jobs_;
+  std::deque<JobId> finished_; //Oldest first
+  const size_t maxFinishedJobs_;
+  JobId nextId_{1};
+  PriorityThreadPool pool_; //Last so its threads are joined before the jobs go
+
+  JobId Submit_(Priority priority, Work work);
+public:
+  JobService(Machine machine, size_t numThreads, size_t maxFinishedJobs = 1024);
+  ~JobService(); //Cancels every job rather than waiting for queued and running ones
+  JobService(const JobService&) = delete;
+  JobService& operator=(const JobService&) = delete;
+
+  std::string Handle(std::string_view request);
+
+  JobId Encipher(MachineSettings settings, std::string text); //Also deciphers
+  JobId Search(Plugs plugs, std::string crib, std::string cipherText, SearchMode mode = SearchMode::RingSettings);
+  std::optional<JobStatus> Status(JobId id) const;
+  std::optional<JobState> Cancel(JobId id);
+  void CancelAll(); //Queued jobs are cancelled at once, running ones when they next check
+};
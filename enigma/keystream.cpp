@@ -0,0 +1,81 @@
+#include "pch.h"
+#include <algorithm>
+#include <bit>
+#include "keystream.h"
+
+Keystream::Keystream(Machine configured, size_t windowSize):
+  start_{configured},
+  machine_{configured},
+  window_(std::bit_ceil(std::max<size_t>(windowSize, 1))),
+  replay_{std::move(configured)}
+{
+}
+
+/*static*/ Permutation Keystream::NextPermutation_(Machine& machine)
+{
+  machine.Step();
+
+  Permutation permutation;
+  for (size_t key = 0; key != c_numChars; ++key)
+    permutation[key] = machine.Map(Key{} + static_cast<int>(key));
+  return permutation;
+}
+
+Permutation Keystream::At(size_t position)
+{
+  const auto mask = window_.size() - 1;
+
+  while (produced_ <= position)
+    window_[produced_++ & mask] = NextPermutation_(machine_);
+
+  if (produced_ - position <= window_.size())
+    return window_[position & mask];
+
+  //Fallen out of the window, so replay, from the start if behind the replay too
+  if (position < replayed_)
+  {
+    replay_ = start_;
+    replayed_ = 0;
+  }
+  replaySteps_ += position + 1 - replayed_;
+  for (; replayed_ != position; ++replayed_)
+    replay_.Step();
+  ++replayed_;
+  return NextPermutation_(replay_);
+}
+
+size_t Keystream::Produced() const
+{
+  return produced_;
+}
+
+size_t Keystream::ReplaySteps() const
+{
+  return replaySteps_;
+}
+
+Keystream::Cursor Keystream::From(size_t position)
+{
+  return Cursor{*this, position};
+}
+
+Keystream::Range Keystream::Positions(size_t first, size_t last)
+{
+  return Range{Cursor{*this, first}, Cursor{*this, last}};
+}
+
+std::string Keystream::ToLamp(std::string_view keys, size_t start)
+{
+  std::string lamps;
+  lamps.reserve(keys.size());
+
+  auto cursor = From(start);
+  for (const auto key_: keys)
+  {
+    const auto key = Key::Create(key_);
+    if (!key)
+      return {};
+    lamps += (*cursor++)[key->Index()].Value();
+  }
+  return lamps;
+}
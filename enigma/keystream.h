@@ -0,0 +1,72 @@
+#pragma once
+
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "enigma.h"
+
+//Lamp lit by each key at one position of the stream
+using Permutation = std::array<Lamp, c_numChars>;
+
+//Permutations of a configured machine, produced on demand and memoised in a
+//ring buffer so that several consumers e.g. candidate plaintexts or messages
+//in depth can walk the same stream without stepping the rotors again.
+//Positions older than the window are recomputed by a second machine that
+//carries on from the last one it recomputed, so a consumer that has fallen
+//behind still walks the stream in linear time.
+//Not thread safe; share between coroutines or cursors on one thread.
+class Keystream
+{
+  const Machine start_;
+  Machine machine_; //Stepped to position produced_ - 1
+  size_t produced_{0};
+  std::vector<Permutation> window_; //Power of two, indexed by position
+  Machine replay_; //Stepped to position replayed_ - 1
+  size_t replayed_{0};
+  size_t replaySteps_{0};
+
+  static Permutation NextPermutation_(Machine& machine);
+public:
+  Keystream(Machine configured, size_t windowSize = 64);
+
+  Permutation At(size_t position);
+  size_t Produced() const;
+  size_t ReplaySteps() const; //Rotor steps recomputing positions older than the window
+
+  //Input iterator over the positions from position on, without end
+  class Cursor
+  {
+    Keystream* keystream_{nullptr};
+    size_t position_{0};
+  public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = Permutation;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = Permutation;
+
+    Cursor() = default;
+    Cursor(Keystream& keystream, size_t position): keystream_{&keystream}, position_{position} {}
+    Permutation operator*() const { return keystream_->At(position_); }
+    Cursor& operator++() { ++position_; return *this; }
+    Cursor operator++(int) { auto cursor = *this; ++position_; return cursor; }
+    bool operator==(const Cursor& other) const { return position_ == other.position_; }
+    size_t Position() const { return position_; }
+  };
+
+  struct Range
+  {
+    Cursor first;
+    Cursor last;
+    Cursor begin() const { return first; }
+    Cursor end() const { return last; }
+  };
+
+  Cursor From(size_t position);
+  Range Positions(size_t first, size_t last);
+
+  //As Machine::ToLamp on the configured machine, from position start
+  std::string ToLamp(std::string_view keys, size_t start = 0);
+};
@@ -0,0 +1,171 @@
+#include "pch.h"
+#include <atomic>
+#include <bit>
+#include <memory>
+#include <mutex>
+#include "metrics.h"
+
+namespace
+{
+  //Written only by its own thread, so relaxed load/store is enough and
+  //avoids the cost of a locked increment
+  struct AtomicThreadMetrics
+  {
+    size_t thread{0};
+    std::array<std::atomic<uint64_t>, static_cast<size_t>(MetricCounter::Num)> counters{};
+    struct Histogram
+    {
+      std::array<std::atomic<uint64_t>, LatencyHistogram::c_numBuckets> buckets{};
+      std::atomic<uint64_t> count{0};
+      std::atomic<uint64_t> totalNs{0};
+    };
+    std::array<Histogram, static_cast<size_t>(MetricLatency::Num)> latencies{};
+  };
+
+  void Add(std::atomic<uint64_t>& value, uint64_t n)
+  {
+    value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+
+  struct Registry
+  {
+    std::mutex mutex;
+    std::vector<std::shared_ptr<const AtomicThreadMetrics>> threads; //Kept after their thread exits
+    const std::chrono::steady_clock::time_point start{std::chrono::steady_clock::now()};
+  };
+  Registry& GetRegistry()
+  {
+    static Registry registry;
+    return registry;
+  }
+
+  AtomicThreadMetrics& LocalMetrics()
+  {
+    thread_local const auto local = []
+    {
+      auto metrics = std::make_shared<AtomicThreadMetrics>();
+      auto& registry = GetRegistry();
+      std::lock_guard lock{registry.mutex};
+      metrics->thread = registry.threads.size();
+      registry.threads.push_back(metrics);
+      return metrics;
+    }();
+    return *local;
+  }
+}
+
+void AddMetric(MetricCounter counter, uint64_t n)
+{
+  Add(LocalMetrics().counters[static_cast<size_t>(counter)], n);
+}
+
+void AddMetric(MetricLatency latency, std::chrono::steady_clock::duration duration)
+{
+  const auto ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+  const auto bucket = std::min<size_t>(std::bit_width(ns), LatencyHistogram::c_numBuckets - 1);
+
+  auto& histogram = LocalMetrics().latencies[static_cast<size_t>(latency)];
+  Add(histogram.buckets[bucket], 1);
+  Add(histogram.count, 1);
+  Add(histogram.totalNs, ns);
+}
+
+ThreadMetrics MetricsSnapshot::Total() const
+{
+  ThreadMetrics total;
+  for (const auto& thread: threads)
+  {
+    for (size_t counter = 0; counter != total.counters.size(); ++counter)
+      total.counters[counter] += thread.counters[counter];
+    for (size_t latency = 0; latency != total.latencies.size(); ++latency)
+    {
+      auto& histogram = total.latencies[latency];
+      const auto& threadHistogram = thread.latencies[latency];
+      for (size_t bucket = 0; bucket != histogram.buckets.size(); ++bucket)
+        histogram.buckets[bucket] += threadHistogram.buckets[bucket];
+      histogram.count += threadHistogram.count;
+      histogram.totalNs += threadHistogram.totalNs;
+    }
+  }
+  return total;
+}
+
+MetricsSnapshot TakeMetricsSnapshot()
+{
+  auto& registry = GetRegistry();
+  std::lock_guard lock{registry.mutex};
+
+  MetricsSnapshot snapshot;
+  snapshot.uptimeNs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - registry.start).count());
+
+  for (const auto& thread: registry.threads)
+  {
+    auto& copy = snapshot.threads.emplace_back();
+    copy.thread = thread->thread;
+    for (size_t counter = 0; counter != copy.counters.size(); ++counter)
+      copy.counters[counter] = thread->counters[counter].load(std::memory_order_relaxed);
+    for (size_t latency = 0; latency != copy.latencies.size(); ++latency)
+    {
+      auto& histogram = copy.latencies[latency];
+      const auto& threadHistogram = thread->latencies[latency];
+      for (size_t bucket = 0; bucket != histogram.buckets.size(); ++bucket)
+        histogram.buckets[bucket] = threadHistogram.buckets[bucket].load(std::memory_order_relaxed);
+      histogram.count = threadHistogram.count.load(std::memory_order_relaxed);
+      histogram.totalNs = threadHistogram.totalNs.load(std::memory_order_relaxed);
+    }
+  }
+  return snapshot;
+}
+
+static std::string ToJson(const ThreadMetrics& metrics)
+{
+  static const std::array<const char*, static_cast<size_t>(MetricCounter::Num)> counterNames =
+    {"keystrokes", "configures", "plugBoards", "searchCandidates", "searchHits"};
+  static const std::array<const char*, static_cast<size_t>(MetricLatency::Num)> latencyNames =
+    {"toLamp", "plugBoardCreate", "search"};
+
+  std::string json = "{\"counters\":{";
+  for (size_t counter = 0; counter != metrics.counters.size(); ++counter)
+  {
+    json += counter ? ",\"" : "\"";
+    json += counterNames[counter];
+    json += "\":" + std::to_string(metrics.counters[counter]);
+  }
+  json += "},\"latencies\":{";
+  for (size_t latency = 0; latency != metrics.latencies.size(); ++latency)
+  {
+    const auto& histogram = metrics.latencies[latency];
+    json += latency ? ",\"" : "\"";
+    json += latencyNames[latency];
+    json += "\":{\"count\":" + std::to_string(histogram.count) +
+            ",\"totalNs\":" + std::to_string(histogram.totalNs) + ",\"buckets\":[";
+    bool first = true;
+    for (size_t bucket = 0; bucket != histogram.buckets.size(); ++bucket)
+    {
+      if (!histogram.buckets[bucket])
+        continue;
+      json += first ? "{\"ltNs\":" : ",{\"ltNs\":";
+      json += std::to_string(uint64_t{1} << bucket) + ",\"count\":" + std::to_string(histogram.buckets[bucket]) + "}";
+      first = false;
+    }
+    json += "]}";
+  }
+  json += "}}";
+  return json;
+}
+
+std::string ToJson(const MetricsSnapshot& snapshot)
+{
+  std::string json = "{\"enabled\":";
+  json += MetricsEnabled() ? "true" : "false";
+  json += ",\"uptimeNs\":" + std::to_string(snapshot.uptimeNs) + ",\"total\":" + ToJson(snapshot.Total()) + ",\"threads\":[";
+  for (const auto& thread: snapshot.threads)
+  {
+    if (&thread != &snapshot.threads.front())
+      json += ',';
+    json += "{\"thread\":" + std::to_string(thread.thread) + ',' + ToJson(thread).substr(1);
+  }
+  json += "]}";
+  return json;
+}
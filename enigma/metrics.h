@@ -0,0 +1,91 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//Counters and latency histograms kept per thread without locks.
+//Instrument code with ENIGMA_COUNT and ENIGMA_TIME, which compile to nothing
+//unless ENIGMA_METRICS is defined, and read them back with TakeMetricsSnapshot.
+
+enum class MetricCounter : unsigned char
+{
+  Keystrokes,
+  Configures,
+  PlugBoards,
+  SearchCandidates,
+  SearchHits,
+  Num
+};
+enum class MetricLatency : unsigned char
+{
+  ToLamp, //A whole string of keys
+  PlugBoardCreate,
+  Search,
+  Num
+};
+
+constexpr bool MetricsEnabled()
+{
+#ifdef ENIGMA_METRICS
+  return true;
+#else
+  return false;
+#endif
+}
+
+struct LatencyHistogram
+{
+  static constexpr size_t c_numBuckets = 40;
+  std::array<uint64_t, c_numBuckets> buckets{}; //buckets[i] counts latencies < 2^i ns
+  uint64_t count{0};
+  uint64_t totalNs{0};
+};
+
+struct ThreadMetrics
+{
+  size_t thread{0}; //In order of first use
+  std::array<uint64_t, static_cast<size_t>(MetricCounter::Num)> counters{};
+  std::array<LatencyHistogram, static_cast<size_t>(MetricLatency::Num)> latencies{};
+};
+
+struct MetricsSnapshot
+{
+  uint64_t uptimeNs{0};
+  std::vector<ThreadMetrics> threads;
+  ThreadMetrics Total() const;
+};
+
+MetricsSnapshot TakeMetricsSnapshot();
+std::string ToJson(const MetricsSnapshot& snapshot);
+
+void AddMetric(MetricCounter counter, uint64_t n);
+void AddMetric(MetricLatency latency, std::chrono::steady_clock::duration duration);
+
+class MetricTimer
+{
+  MetricLatency latency_;
+  std::chrono::steady_clock::time_point start_;
+public:
+  MetricTimer(MetricLatency latency):
+    latency_{latency}, start_{std::chrono::steady_clock::now()}
+  {}
+  ~MetricTimer()
+  {
+    AddMetric(latency_, std::chrono::steady_clock::now() - start_);
+  }
+  MetricTimer(const MetricTimer&) = delete;
+  MetricTimer& operator=(const MetricTimer&) = delete;
+};
+
+#ifdef ENIGMA_METRICS
+#define ENIGMA_METRICS_CONCAT_(a, b) a##b
+#define ENIGMA_METRICS_TIMER_(line) ENIGMA_METRICS_CONCAT_(metricTimer_, line)
+#define ENIGMA_COUNT(counter, n) AddMetric(MetricCounter::counter, (n))
+#define ENIGMA_TIME(latency) const MetricTimer ENIGMA_METRICS_TIMER_(__LINE__){MetricLatency::latency}
+#else
+#define ENIGMA_COUNT(counter, n) ((void)0)
+#define ENIGMA_TIME(latency) ((void)0)
+#endif
@@ -0,0 +1,137 @@
+#include "pch.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include "normalise.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ENIGMA_SSE2
+#include <emmintrin.h>
+#endif
+
+static constexpr size_t c_blockSize = 16;
+static constexpr size_t c_longestMapping = 6; //"SIEBEN"
+
+//Anything but a letter, one at a time
+static void NormaliseSeparator(char c, size_t& numKeys, NormalisedText& normalised, const NormaliseOptions& options)
+{
+  static const std::array<std::string_view, 10> numbers =
+    {"NULL", "EINS", "ZWO", "DREI", "VIER", "FUNF", "SEQS", "SIEBEN", "ACHT", "NEUN"};
+
+  std::string_view mapped;
+  if (c == '.' && options.fullStopToX)
+    mapped = "X";
+  else if (c >= '0' && c <= '9' && options.spellNumbers)
+    mapped = numbers[c - '0'];
+
+  if (mapped.empty())
+  {
+    normalised.dropped.push_back(Dropped{numKeys, c});
+    return;
+  }
+  std::copy(mapped.cbegin(), mapped.cend(), normalised.keys.begin() + numKeys);
+  numKeys += mapped.size();
+}
+
+static char ToUpper(char c)
+{
+  return (c >= 'a' && c <= 'z') ? static_cast<char>(c - ('a' - 'A')) : c;
+}
+
+void Normalise(std::string_view text, NormalisedText& normalised, const NormaliseOptions& options)
+{
+  auto& keys = normalised.keys;
+  normalised.dropped.clear();
+  keys.resize(text.size() + c_blockSize);
+  size_t numKeys = 0;
+
+  //Room for a whole block of mapped separators
+  const auto ensureSpace = [&keys, &numKeys]
+  {
+    if (keys.size() < numKeys + c_blockSize*c_longestMapping)
+      keys.resize(2*keys.size() + c_blockSize*c_longestMapping);
+  };
+
+  size_t pos = 0;
+#ifdef ENIGMA_SSE2
+  const auto lowerA = _mm_set1_epi8('a' - 1);
+  const auto lowerZ = _mm_set1_epi8('z' + 1);
+  const auto upperA = _mm_set1_epi8('A' - 1);
+  const auto upperZ = _mm_set1_epi8('Z' + 1);
+  const auto caseBit = _mm_set1_epi8('a' - 'A');
+
+  for (; pos + c_blockSize <= text.size(); pos += c_blockSize)
+  {
+    ensureSpace();
+
+    auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text.data() + pos));
+    const auto isLower = _mm_and_si128(_mm_cmpgt_epi8(block, lowerA), _mm_cmplt_epi8(block, lowerZ));
+    block = _mm_sub_epi8(block, _mm_and_si128(isLower, caseBit));
+    const auto isLetter = _mm_and_si128(_mm_cmpgt_epi8(block, upperA), _mm_cmplt_epi8(block, upperZ));
+    const auto letterMask = static_cast<unsigned>(_mm_movemask_epi8(isLetter));
+
+    if (letterMask == 0xFFFF)
+    {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(keys.data() + numKeys), block);
+      numKeys += c_blockSize;
+      continue;
+    }
+
+    //Copy the runs of letters between separators
+    alignas(16) std::array<char, c_blockSize> upper;
+    _mm_store_si128(reinterpret_cast<__m128i*>(upper.data()), block);
+    size_t begin = 0;
+    for (auto separators = ~letterMask & 0xFFFF; separators; separators &= separators - 1)
+    {
+      const auto end = static_cast<size_t>(std::countr_zero(separators));
+      std::copy(upper.data() + begin, upper.data() + end, keys.data() + numKeys);
+      numKeys += end - begin;
+      NormaliseSeparator(upper[end], numKeys, normalised, options);
+      begin = end + 1;
+    }
+    std::copy(upper.data() + begin, upper.data() + c_blockSize, keys.data() + numKeys);
+    numKeys += c_blockSize - begin;
+  }
+#endif
+
+  for (; pos != text.size(); ++pos)
+  {
+    ensureSpace();
+    const auto c = ToUpper(text[pos]);
+    if (c >= 'A' && c <= 'Z')
+      keys[numKeys++] = c;
+    else
+      NormaliseSeparator(c, numKeys, normalised, options);
+  }
+
+  keys.resize(numKeys);
+}
+
+NormalisedText Normalise(std::string_view text, const NormaliseOptions& options)
+{
+  NormalisedText normalised;
+  Normalise(text, normalised, options);
+  return normalised;
+}
+
+std::string Restore(std::string_view keys, const std::vector<Dropped>& dropped)
+{
+  std::string text;
+  text.reserve(keys.size() + dropped.size());
+
+  size_t pos = 0;
+  for (const auto& separator: dropped)
+  {
+    text.append(keys.substr(pos, separator.at - pos));
+    text += separator.c;
+    pos = separator.at;
+  }
+  text.append(keys.substr(pos));
+  return text;
+}
+
+std::string ToLampFormatted(Machine& machine, std::string_view text, const NormaliseOptions& options)
+{
+  const auto normalised = Normalise(text, options);
+  return Restore(machine.ToLamp(normalised.keys), normalised.dropped);
+}
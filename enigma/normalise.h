@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "enigma.h"
+
+struct NormaliseOptions
+{
+  bool fullStopToX{true};    //"." becomes "X"
+  bool spellNumbers{true};   //"1" becomes "EINS" etc.
+};
+
+//A separator removed from the text, to be put back by Restore
+struct Dropped
+{
+  size_t at; //Number of keys before it
+  char c;
+};
+
+struct NormalisedText
+{
+  std::string keys; //Only 'A'-'Z'
+  std::vector<Dropped> dropped;
+};
+
+//Uppercases letters, maps full stops and digits as per options and drops
+//everything else, in 16 byte SSE2 blocks where available.
+//Reuses normalised's buffers.
+void Normalise(std::string_view text, NormalisedText& normalised, const NormaliseOptions& options = {});
+NormalisedText Normalise(std::string_view text, const NormaliseOptions& options = {});
+
+//Put the dropped separators back into keys of the same length as those normalised
+std::string Restore(std::string_view keys, const std::vector<Dropped>& dropped);
+
+//Encipher free text, keeping its spacing and punctuation
+std::string ToLampFormatted(Machine& machine, std::string_view text, const NormaliseOptions& options = {});
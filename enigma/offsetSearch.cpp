@@ -0,0 +1,183 @@
+#include "pch.h"
+#include <map>
+#include "metrics.h"
+#include "offsetSearch.h"
+
+static Key Minus(Key key, size_t offset)
+{
+  return key + static_cast<int>(c_numChars - offset);
+}
+
+std::vector<std::vector<MiddleRightPositions>> StepClasses(const Machine& machine,
+                                                           const WheelOrder& wheelOrder,
+                                                           size_t numKeys)
+{
+  //Keyed by how far the left and middle rotors have stepped after each key
+  std::map<std::vector<unsigned char>, std::vector<MiddleRightPositions>> classes;
+
+  auto m = machine;
+  const auto plugBoard = PlugBoard::Create();
+  for (size_t middle = 0; middle != c_numChars; ++middle)
+  for (size_t right = 0; right != c_numChars; ++right)
+  {
+    const MiddleRightPositions positions{Key{} + static_cast<int>(middle), Key{} + static_cast<int>(right)};
+    m.Configure({WheelSelection{wheelOrder[0], Key{}},
+                 WheelSelection{wheelOrder[1], Key{}, positions[0]},
+                 WheelSelection{wheelOrder[2], Key{}, positions[1]}},
+                plugBoard);
+
+    std::vector<unsigned char> steps;
+    steps.reserve(2*numKeys);
+    for (size_t key = 0; key != numKeys; ++key)
+    {
+      m.Step();
+      const auto stepped = m.Positions();
+      steps.push_back(static_cast<unsigned char>(stepped[0].Index()));
+      steps.push_back(static_cast<unsigned char>((stepped[1].Index() + c_numChars - middle) % c_numChars));
+    }
+    classes[steps].push_back(positions);
+  }
+
+  std::vector<std::vector<MiddleRightPositions>> stepClasses;
+  stepClasses.reserve(classes.size());
+  for (auto& [steps, positions]: classes)
+    stepClasses.push_back(std::move(positions));
+  return stepClasses;
+}
+
+static std::array<WheelSelection, numScramblerRotors> ToSelections(const WheelOrder& wheelOrder,
+                                                                   const std::array<size_t, numScramblerRotors>& offsets,
+                                                                   Key left,
+                                                                   const MiddleRightPositions& middleRight)
+{
+  const auto& [middle, right] = middleRight;
+  return {WheelSelection{wheelOrder[0], Minus(left, offsets[0]), left},
+          WheelSelection{wheelOrder[1], Minus(middle, offsets[1]), middle},
+          WheelSelection{wheelOrder[2], Minus(right, offsets[2]), right}};
+}
+
+//Offset of each rotor after each of numKeys steps, which with the wiring
+//decides the keystream
+static std::vector<unsigned char> OffsetSteps(const Machine& machine,
+                                              const std::array<WheelSelection, numScramblerRotors>& selections,
+                                              size_t numKeys)
+{
+  auto m = machine;
+  m.Configure(selections, PlugBoard::Create());
+
+  std::vector<unsigned char> steps;
+  steps.reserve(numScramblerRotors*numKeys);
+  for (size_t key = 0; key != numKeys; ++key)
+  {
+    m.Step();
+    const auto positions = m.Positions();
+    for (size_t rotor = 0; rotor != numScramblerRotors; ++rotor)
+      steps.push_back(static_cast<unsigned char>((positions[rotor].Index() + c_numChars - selections[rotor].ringSetting.Index()) % c_numChars));
+  }
+  return steps;
+}
+
+size_t EquivalentKeys::Count() const
+{
+  size_t count = 0;
+  for (const auto& keys: classes)
+    count += c_numChars*keys.positions.size();
+  return count;
+}
+
+std::vector<std::array<WheelSelection, numScramblerRotors>> EquivalentKeys::Expand() const
+{
+  std::vector<std::array<WheelSelection, numScramblerRotors>> keys;
+  keys.reserve(Count());
+  for (const auto& [offsets, positions]: classes)
+    for (size_t left = 0; left != c_numChars; ++left)
+      for (const auto& middleRight: positions)
+        keys.push_back(ToSelections(wheelOrder, offsets, Key{} + static_cast<int>(left), middleRight));
+  return keys;
+}
+
+std::string ToString(const EquivalentKeys& keys, const Plugs& plugs)
+{
+  const auto& first = keys.classes.front();
+  return ToString(MachineSettings{ToSelections(keys.wheelOrder, first.offsets, Key{}, first.positions.front()), plugs})
+       + " x" + std::to_string(keys.Count());
+}
+
+std::vector<EquivalentKeys> SearchCribByOffset(const Machine& machine,
+                                               const WheelOrder& wheelOrder,
+                                               const Plugs& plugs,
+                                               std::string_view crib,
+                                               std::string_view cipherText,
+                                               const std::atomic<bool>& cancelled)
+{
+  ENIGMA_TIME(Search);
+
+  std::vector<EquivalentKeys> hits;
+
+  const auto plainKeys = ToKeys(crib.substr(0, cipherText.size()));
+  const auto cipherKeys = ToKeys(cipherText.substr(0, crib.size()));
+  const auto plugBoard = PlugBoard::Create(plugs);
+  if (!plainKeys || !cipherKeys || !plugBoard || plainKeys->empty())
+    return hits;
+
+  //Hits by the offsets they step through, to merge those with the same keystream
+  std::map<std::vector<unsigned char>, size_t> hitIndexes;
+
+  auto candidate = machine;
+  size_t numKeystrokes = 0; //Since last counted, a step class at a time
+  for (const auto& stepClass: StepClasses(machine, wheelOrder, plainKeys->size()))
+  {
+    ENIGMA_COUNT(Keystrokes, numKeystrokes);
+    numKeystrokes = 0;
+    if (cancelled)
+      return hits;
+    ENIGMA_COUNT(SearchCandidates, c_numRingSettings);
+
+    for (size_t offsets = 0; offsets != c_numRingSettings; ++offsets)
+    {
+      const std::array<size_t, numScramblerRotors> offset = {offsets/(c_numChars*c_numChars),
+                                                             offsets/c_numChars%c_numChars,
+                                                             offsets%c_numChars};
+      const auto selections = ToSelections(wheelOrder, offset, Key{}, stepClass.front());
+      candidate.Configure(selections, *plugBoard);
+
+      const auto mismatch = std::mismatch(plainKeys->cbegin(), plainKeys->cend(),
+                                          cipherKeys->cbegin(), [&candidate](const auto plain, const auto cipher)
+      {
+        return candidate.ToLamp(plain) == cipher;
+      });
+      //Up to and including the first mismatch
+      numKeystrokes += std::min<size_t>(mismatch.first - plainKeys->cbegin() + 1, plainKeys->size());
+      if (mismatch.first == plainKeys->cend())
+      {
+        const auto [hitIndex, added] = hitIndexes.try_emplace(OffsetSteps(machine, selections, plainKeys->size()), hits.size());
+        if (added)
+        {
+          ENIGMA_COUNT(SearchHits, 1);
+          hits.push_back(EquivalentKeys{wheelOrder, {}});
+        }
+        hits[hitIndex->second].classes.push_back(EquivalentKeys::Class{offset, stepClass});
+      }
+    }
+  }
+  ENIGMA_COUNT(Keystrokes, numKeystrokes);
+
+  return hits;
+}
+
+std::vector<EquivalentKeys> SearchCribByOffset(const Machine& machine,
+                                               const Plugs& plugs,
+                                               std::string_view crib,
+                                               std::string_view cipherText,
+                                               const std::atomic<bool>& cancelled)
+{
+  std::vector<EquivalentKeys> hits;
+  for (const auto& wheelOrder: WheelOrders())
+  {
+    auto wheelOrderHits = SearchCribByOffset(machine, wheelOrder, plugs, crib, cipherText, cancelled);
+    hits.insert(hits.end(), std::make_move_iterator(wheelOrderHits.begin()), std::make_move_iterator(wheelOrderHits.end()));
+    if (cancelled)
+      break;
+  }
+  return hits;
+}
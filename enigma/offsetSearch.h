@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "search.h"
+
+//The wiring of a rotor only depends on its position less its ring setting,
+//its offset, while the ring setting and start position apart only decide
+//when it steps its neighbour. Over a short message most start positions step
+//the same way, so searching offsets against one position of each stepping
+//class covers every ring setting and start position far quicker than
+//searching the two separately.
+
+using MiddleRightPositions = std::array<Key, 2>;
+
+//Groups the start positions of the middle and right rotors (left at 'A') by
+//how the rotors step over numKeys keys
+std::vector<std::vector<MiddleRightPositions>> StepClasses(const Machine& machine,
+                                                           const WheelOrder& wheelOrder,
+                                                           size_t numKeys);
+
+//Every key giving the same keystream over the message: for each class, any
+//start position of the left rotor and any of the listed middle and right start
+//positions, with the ring settings that keep the offsets.
+//Usually one class, but a middle rotor starting at its turnover double steps
+//on the first key into the offsets of a class starting a position earlier.
+struct EquivalentKeys
+{
+  struct Class
+  {
+    std::array<size_t, numScramblerRotors> offsets; //Position less ring setting
+    std::vector<MiddleRightPositions> positions;
+  };
+  WheelOrder wheelOrder;
+  std::vector<Class> classes;
+
+  size_t Count() const;
+  std::vector<std::array<WheelSelection, numScramblerRotors>> Expand() const;
+};
+
+//The first of the keys, with plugs, and how many there are e.g. "124 PMJ AAS EN,IG x624"
+std::string ToString(const EquivalentKeys& keys, const Plugs& plugs);
+
+//As SearchCrib, but over start positions as well as ring settings, each
+//keystream that fits the crib reported once with all its keys
+std::vector<EquivalentKeys> SearchCribByOffset(const Machine& machine,
+                                               const WheelOrder& wheelOrder,
+                                               const Plugs& plugs,
+                                               std::string_view crib,
+                                               std::string_view cipherText,
+                                               const std::atomic<bool>& cancelled);
+std::vector<EquivalentKeys> SearchCribByOffset(const Machine& machine,
+                                               const Plugs& plugs,
+                                               std::string_view crib,
+                                               std::string_view cipherText,
+                                               const std::atomic<bool>& cancelled);
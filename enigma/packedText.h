@@ -0,0 +1,213 @@
+#pragma once
+
+#include <bit>
+#include <compare>
+#include <cstdint>
+#include <initializer_list>
+#include <iterator>
+#include <memory_resource>
+#include <vector>
+
+//Vector of IntRange characters packed into the fewest bits that hold one
+//e.g. 5 bits for 'A'-'Z', instead of a byte each.
+//Element access returns by value, or through Reference for assignment.
+//Takes a polymorphic allocator so texts can live in an Arena.
+template <typename TChar>
+class PackedText
+{
+  using Word = uint64_t;
+  static constexpr size_t c_wordBits = 64;
+public:
+  static constexpr size_t c_bits = std::bit_width(TChar::num() - 1);
+private:
+  static constexpr Word c_mask = (Word{1} << c_bits) - 1;
+
+  std::pmr::vector<Word> words_;
+  size_t size_{0};
+
+  size_t Get_(size_t index) const
+  {
+    const auto bit = index*c_bits;
+    const auto word = bit/c_wordBits;
+    const auto offset = bit%c_wordBits;
+    auto value = words_[word] >> offset;
+    if (offset + c_bits > c_wordBits)
+      value |= words_[word + 1] << (c_wordBits - offset);
+    return static_cast<size_t>(value & c_mask);
+  }
+  void Set_(size_t index, size_t value)
+  {
+    const auto bit = index*c_bits;
+    const auto word = bit/c_wordBits;
+    const auto offset = bit%c_wordBits;
+    words_[word] = (words_[word] & ~(c_mask << offset)) | (Word{value} << offset);
+    if (offset + c_bits > c_wordBits)
+    {
+      const auto shift = c_wordBits - offset;
+      words_[word + 1] = (words_[word + 1] & ~(c_mask >> shift)) | (Word{value} >> shift);
+    }
+  }
+  static size_t NumWords_(size_t size)
+  {
+    return (size*c_bits + c_wordBits - 1)/c_wordBits;
+  }
+  void Truncate_(size_t size)
+  {
+    words_.resize(NumWords_(size));
+    size_ = size;
+    if (const auto tailBits = size*c_bits%c_wordBits)
+      words_.back() &= (Word{1} << tailBits) - 1;
+  }
+public:
+  using value_type = TChar;
+  using size_type = size_t;
+  using allocator_type = std::pmr::polymorphic_allocator<Word>;
+
+  class Reference
+  {
+    PackedText& text_;
+    size_t index_;
+  public:
+    Reference(PackedText& text, size_t index): text_{text}, index_{index} {}
+    operator TChar() const { return static_cast<const PackedText&>(text_)[index_]; }
+    Reference& operator=(TChar c) { text_.Set_(index_, c.Index()); return *this; }
+    Reference& operator=(const Reference& other) { return *this = static_cast<TChar>(other); }
+    auto Value() const { return static_cast<TChar>(*this).Value(); }
+    size_t Index() const { return static_cast<TChar>(*this).Index(); }
+  };
+
+  class const_iterator
+  {
+    const PackedText* text_{nullptr};
+    size_t index_{0};
+  public:
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = TChar;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = TChar;
+
+    const_iterator() = default;
+    const_iterator(const PackedText& text, size_t index): text_{&text}, index_{index} {}
+
+    TChar operator*() const { return (*text_)[index_]; }
+    TChar operator[](difference_type n) const { return (*text_)[index_ + n]; }
+    const_iterator& operator++() { ++index_; return *this; }
+    const_iterator operator++(int) { auto itr = *this; ++index_; return itr; }
+    const_iterator& operator--() { --index_; return *this; }
+    const_iterator operator--(int) { auto itr = *this; --index_; return itr; }
+    const_iterator& operator+=(difference_type n) { index_ += n; return *this; }
+    const_iterator& operator-=(difference_type n) { index_ -= n; return *this; }
+    const_iterator operator+(difference_type n) const { return const_iterator{*text_, index_ + n}; }
+    const_iterator operator-(difference_type n) const { return const_iterator{*text_, index_ - n}; }
+    friend const_iterator operator+(difference_type n, const const_iterator& itr) { return itr + n; }
+    difference_type operator-(const const_iterator& other) const
+    {
+      return static_cast<difference_type>(index_) - static_cast<difference_type>(other.index_);
+    }
+    bool operator==(const const_iterator& other) const { return index_ == other.index_; }
+    auto operator<=>(const const_iterator& other) const { return index_ <=> other.index_; }
+  };
+  using iterator = const_iterator;
+
+  PackedText() = default;
+  explicit PackedText(const allocator_type& allocator): words_{allocator} {}
+  PackedText(const PackedText& other) = default;
+  PackedText(const PackedText& other, const allocator_type& allocator):
+    words_{other.words_, allocator}, size_{other.size_}
+  {}
+  PackedText(PackedText&& other) noexcept = default;
+  PackedText& operator=(const PackedText& other) = default;
+  PackedText& operator=(PackedText&& other) = default;
+
+  PackedText(std::initializer_list<TChar> text, const allocator_type& allocator = {}):
+    words_{allocator}
+  {
+    assign(text.begin(), text.end());
+  }
+  template <typename TItr>
+  PackedText(TItr begin, TItr end, const allocator_type& allocator = {}):
+    words_{allocator}
+  {
+    assign(begin, end);
+  }
+
+  allocator_type get_allocator() const { return words_.get_allocator(); }
+
+  template <typename TItr>
+  void assign(TItr begin, TItr end)
+  {
+    clear();
+    for (; begin != end; ++begin)
+      push_back(*begin);
+  }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  size_t capacity() const { return words_.capacity()*c_wordBits/c_bits; }
+  void reserve(size_t size) { words_.reserve(NumWords_(size)); }
+  void clear() { words_.clear(); size_ = 0; }
+  void shrink_to_fit() { words_.shrink_to_fit(); }
+
+  void resize(size_t size, TChar c = TChar{})
+  {
+    if (size <= size_)
+      return Truncate_(size);
+
+    const auto oldSize = size_;
+    words_.resize(NumWords_(size));
+    size_ = size;
+    for (auto index = oldSize; index != size; ++index)
+      Set_(index, c.Index());
+  }
+  void push_back(TChar c)
+  {
+    if (NumWords_(size_ + 1) != words_.size())
+      words_.push_back(0);
+    Set_(size_++, c.Index());
+  }
+  void pop_back()
+  {
+    Truncate_(size_ - 1);
+  }
+
+  TChar operator[](size_t index) const { return TChar{} + static_cast<int>(Get_(index)); }
+  Reference operator[](size_t index) { return Reference{*this, index}; }
+  TChar front() const { return (*this)[0]; }
+  TChar back() const { return (*this)[size_ - 1]; }
+
+  //Calls fnc(index) with the Index() of each char in order, unpacking a word
+  //at a time rather than locating each char
+  template <typename TFnc>
+  void ForEachIndex(TFnc fnc) const
+  {
+    auto remaining = size_;
+    Word carry = 0; //Low bits of a char split between words
+    size_t carryBits = 0;
+    for (const auto word: words_)
+    {
+      size_t offset = 0;
+      if (carryBits)
+      {
+        fnc(static_cast<size_t>((carry | (word << carryBits)) & c_mask));
+        offset = c_bits - carryBits;
+        --remaining;
+      }
+      for (; remaining && offset + c_bits <= c_wordBits; offset += c_bits, --remaining)
+        fnc(static_cast<size_t>((word >> offset) & c_mask));
+      carryBits = (remaining && offset != c_wordBits) ? c_wordBits - offset : 0;
+      carry = carryBits ? word >> offset : 0;
+    }
+  }
+
+  const_iterator begin() const { return const_iterator{*this, 0}; }
+  const_iterator end() const { return const_iterator{*this, size_}; }
+  const_iterator cbegin() const { return begin(); }
+  const_iterator cend() const { return end(); }
+
+  //Bits beyond size() are kept zero so whole words compare
+  bool operator==(const PackedText& other) const
+  {
+    return size_ == other.size_ && words_ == other.words_;
+  }
+};
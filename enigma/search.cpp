@@ -0,0 +1,156 @@
+#include "pch.h"
+#include "metrics.h"
+#include "search.h"
+
+static const auto c_wheelOrders = []
+{
+  std::array<WheelOrder, c_numWheelOrders> wheelOrders;
+  size_t order = 0;
+  for (unsigned char left = 0; left != numMachineWheels; ++left)
+  for (unsigned char middle = 0; middle != numMachineWheels; ++middle)
+  for (unsigned char right = 0; right != numMachineWheels; ++right)
+    if (left != middle && middle != right && right != left)
+      wheelOrders[order++] = {*WheelIndex::Create(left), *WheelIndex::Create(middle), *WheelIndex::Create(right)};
+  return wheelOrders;
+}();
+
+const std::array<WheelOrder, c_numWheelOrders>& WheelOrders()
+{
+  return c_wheelOrders;
+}
+
+std::array<WheelSelection, numScramblerRotors> ToSelections(size_t scramblerKey)
+{
+  const auto& wheelOrder = c_wheelOrders[scramblerKey/c_numRingSettings];
+  const auto ringSettings = scramblerKey%c_numRingSettings;
+  return
+  {
+    WheelSelection{wheelOrder[0], Key{} + static_cast<int>(ringSettings/(c_numChars*c_numChars))},
+    WheelSelection{wheelOrder[1], Key{} + static_cast<int>(ringSettings/c_numChars%c_numChars)},
+    WheelSelection{wheelOrder[2], Key{} + static_cast<int>(ringSettings%c_numChars)},
+  };
+}
+
+std::optional<std::vector<Key>> ToKeys(std::string_view text)
+{
+  std::vector<Key> keys;
+  keys.reserve(text.size());
+  for (const auto c: text)
+  {
+    const auto key = Key::Create(c);
+    if (!key)
+      return {};
+    keys.push_back(*key);
+  }
+  return keys;
+}
+
+std::vector<MachineSettings> SearchCrib(const Machine& machine,
+                                        const Plugs& plugs,
+                                        std::string_view crib,
+                                        std::string_view cipherText,
+                                        const std::atomic<bool>& cancelled)
+{
+  ENIGMA_TIME(Search);
+
+  std::vector<MachineSettings> hits;
+
+  const auto plainKeys = ToKeys(crib.substr(0, cipherText.size()));
+  const auto cipherKeys = ToKeys(cipherText.substr(0, crib.size()));
+  const auto plugBoard = PlugBoard::Create(plugs);
+  if (!plainKeys || !cipherKeys || !plugBoard || plainKeys->empty())
+    return hits;
+
+  auto candidate = machine;
+  size_t numKeystrokes = 0; //Since last counted, a wheel order at a time
+  for (size_t scramblerKey = 0; scramblerKey != c_numScramblerKeys; ++scramblerKey)
+  {
+    if (scramblerKey%c_numRingSettings == 0)
+    {
+      ENIGMA_COUNT(Keystrokes, numKeystrokes);
+      numKeystrokes = 0;
+      if (cancelled)
+        return hits;
+      ENIGMA_COUNT(SearchCandidates, c_numRingSettings);
+    }
+
+    const auto selections = ToSelections(scramblerKey);
+    candidate.Configure(selections, *plugBoard);
+
+    const auto mismatch = std::mismatch(plainKeys->cbegin(), plainKeys->cend(),
+                                        cipherKeys->cbegin(), [&candidate](const auto plain, const auto cipher)
+    {
+      return candidate.ToLamp(plain) == cipher;
+    });
+    //Up to and including the first mismatch
+    numKeystrokes += std::min<size_t>(mismatch.first - plainKeys->cbegin() + 1, plainKeys->size());
+    if (mismatch.first == plainKeys->cend())
+    {
+      ENIGMA_COUNT(SearchHits, 1);
+      hits.push_back(MachineSettings{selections, plugs});
+    }
+  }
+  ENIGMA_COUNT(Keystrokes, numKeystrokes);
+
+  return hits;
+}
+
+TopKeys::TopKeys(size_t capacity):
+  capacity_{capacity}
+{
+  keys_.reserve(capacity + 1);
+}
+
+void TopKeys::Add(ScoredKey key)
+{
+  const auto better = [](const ScoredKey& lhs, const ScoredKey& rhs)
+  {
+    return lhs.score != rhs.score ? lhs.score > rhs.score : lhs.scramblerKey < rhs.scramblerKey;
+  };
+  if (keys_.size() == capacity_ && (capacity_ == 0 || !better(key, keys_.back())))
+    return;
+
+  keys_.insert(std::upper_bound(keys_.begin(), keys_.end(), key, better), key);
+  if (keys_.size() > capacity_)
+    keys_.pop_back();
+}
+
+const std::vector<ScoredKey>& TopKeys::Keys() const
+{
+  return keys_;
+}
+
+size_t ScoreCrib(const Machine& machine,
+                 const PlugBoard& plugBoard,
+                 const std::vector<Key>& plainKeys,
+                 const std::vector<Key>& cipherKeys,
+                 size_t first,
+                 size_t last,
+                 TopKeys& top,
+                 const std::atomic<bool>& cancelled)
+{
+  ENIGMA_TIME(Search);
+
+  const auto numKeys = std::min(plainKeys.size(), cipherKeys.size());
+  auto candidate = machine;
+  for (auto scramblerKey = first; scramblerKey != last; ++scramblerKey)
+  {
+    if (scramblerKey%c_numChars == 0 && cancelled)
+    {
+      ENIGMA_COUNT(SearchCandidates, scramblerKey - first);
+      ENIGMA_COUNT(Keystrokes, (scramblerKey - first)*numKeys);
+      return scramblerKey;
+    }
+
+    candidate.Configure(ToSelections(scramblerKey), plugBoard);
+
+    size_t score = 0;
+    for (size_t i = 0; i != numKeys; ++i)
+      score += candidate.ToLamp(plainKeys[i]) == cipherKeys[i];
+    top.Add(ScoredKey{scramblerKey, score});
+  }
+  ENIGMA_COUNT(SearchCandidates, last - first);
+  ENIGMA_COUNT(Keystrokes, (last - first)*numKeys);
+
+  return last;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <string_view>
+#include <vector>
+
+#include "settings.h"
+
+//Keys of the scrambler numbered wheel order (distinct wheels) major, ring
+//settings minor, so that ranges of them can be searched separately
+constexpr size_t c_numWheelOrders = numMachineWheels*(numMachineWheels - 1)*(numMachineWheels - 2);
+constexpr size_t c_numRingSettings = c_numChars*c_numChars*c_numChars;
+constexpr size_t c_numScramblerKeys = c_numWheelOrders*c_numRingSettings;
+std::array<WheelSelection, numScramblerRotors> ToSelections(size_t scramblerKey);
+
+using WheelOrder = std::array<WheelIndex, numScramblerRotors>;
+const std::array<WheelOrder, c_numWheelOrders>& WheelOrders();
+
+std::optional<std::vector<Key>> ToKeys(std::string_view text);
+
+//Try every wheel order (distinct wheels) and ring setting with the given plugs,
+//keeping the settings that encipher crib into the start of cipherText.
+//Stops early, returning the hits so far, once cancelled is set.
+std::vector<MachineSettings> SearchCrib(const Machine& machine,
+                                        const Plugs& plugs,
+                                        std::string_view crib,
+                                        std::string_view cipherText,
+                                        const std::atomic<bool>& cancelled);
+
+struct ScoredKey
+{
+  size_t scramblerKey;
+  size_t score;
+};
+
+//Best scores seen, highest first and then by lowest key so results are
+//the same however the keys were split up
+class TopKeys
+{
+  size_t capacity_;
+  std::vector<ScoredKey> keys_;
+public:
+  explicit TopKeys(size_t capacity);
+  void Add(ScoredKey key);
+  const std::vector<ScoredKey>& Keys() const;
+};
+
+//Score scrambler keys [first, last) by how many letters of plainKeys they
+//encipher to cipherKeys. Returns the first key not scored, which is last
+//unless cancelled.
+size_t ScoreCrib(const Machine& machine,
+                 const PlugBoard& plugBoard,
+                 const std::vector<Key>& plainKeys,
+                 const std::vector<Key>& cipherKeys,
+                 size_t first,
+                 size_t last,
+                 TopKeys& top,
+                 const std::atomic<bool>& cancelled);
@@ -0,0 +1,292 @@
+#include "pch.h"
+#include <fstream>
+#include <sstream>
+#include "searchJob.h"
+
+namespace fs = std::filesystem;
+
+size_t SearchJob::NumShards() const
+{
+  return (c_numScramblerKeys + shardSize - 1)/shardSize;
+}
+
+static fs::path JobFile(const fs::path& jobDir)
+{
+  return jobDir/"job.txt";
+}
+static fs::path ClaimDir(const fs::path& jobDir, size_t shard)
+{
+  return jobDir/("shard-" + std::to_string(shard) + ".claim");
+}
+static fs::path DoneFile(const fs::path& jobDir, size_t shard)
+{
+  return jobDir/("shard-" + std::to_string(shard) + ".done");
+}
+
+//Write to a temporary then rename over path
+static bool WriteFile(const fs::path& path, const std::string& text, std::string_view workerName)
+{
+  auto temp = path;
+  temp += ".tmp-" + std::string{workerName};
+  {
+    std::ofstream file{temp, std::ios::binary | std::ios::trunc};
+    if (!(file << text) || !file.flush())
+      return false;
+  }
+  std::error_code ec;
+  fs::rename(temp, path, ec);
+  return !ec;
+}
+
+static std::optional<std::string> ReadFile(const fs::path& path)
+{
+  std::ifstream file{path, std::ios::binary};
+  if (!file)
+    return {};
+  std::ostringstream text;
+  text << file.rdbuf();
+  return text.str();
+}
+
+//"next <key>" then a "<key> <score>" line per top key
+static std::string ToCheckpoint(size_t next, const TopKeys& top)
+{
+  std::string text = "next " + std::to_string(next) + '\n';
+  for (const auto& key: top.Keys())
+    text += std::to_string(key.scramblerKey) + ' ' + std::to_string(key.score) + '\n';
+  return text;
+}
+
+static std::optional<size_t> FromCheckpoint(const std::string& text, TopKeys& top)
+{
+  std::istringstream in{text};
+  std::string next;
+  size_t nextKey = 0;
+  if (!(in >> next >> nextKey) || next != "next")
+    return {};
+
+  ScoredKey key{};
+  while (in >> key.scramblerKey >> key.score)
+    top.Add(key);
+  return nextKey;
+}
+
+bool CreateSearchJob(const fs::path& jobDir, const SearchJob& job)
+{
+  if (job.shardSize == 0 || !ToKeys(job.crib) || !ToKeys(job.cipherText) || !PlugBoard::Create(job.plugs))
+    return false;
+
+  std::error_code ec;
+  fs::create_directories(jobDir, ec);
+  if (ec || fs::exists(JobFile(jobDir)))
+    return false;
+
+  return WriteFile(JobFile(jobDir),
+                   "plugs " + ToString(job.plugs) + '\n' +
+                   "crib " + job.crib + '\n' +
+                   "cipherText " + job.cipherText + '\n' +
+                   "shardSize " + std::to_string(job.shardSize) + '\n' +
+                   "topN " + std::to_string(job.topN) + '\n',
+                   "create");
+}
+
+std::optional<SearchJob> LoadSearchJob(const fs::path& jobDir)
+{
+  const auto text = ReadFile(JobFile(jobDir));
+  if (!text)
+    return {};
+
+  SearchJob job;
+  std::istringstream in{*text};
+  std::string plugs;
+  std::string name;
+  while (in >> name)
+  {
+    if (name == "plugs")
+      in >> plugs;
+    else if (name == "crib")
+      in >> job.crib;
+    else if (name == "cipherText")
+      in >> job.cipherText;
+    else if (name == "shardSize")
+      in >> job.shardSize;
+    else if (name == "topN")
+      in >> job.topN;
+    else
+      return {};
+  }
+
+  auto plugs_ = ParsePlugs(plugs);
+  if (!in.eof() || !plugs_ || job.shardSize == 0)
+    return {};
+  job.plugs = std::move(*plugs_);
+  return job;
+}
+
+static bool IsOwner(const fs::path& jobDir, size_t shard, std::string_view workerName)
+{
+  const auto owner = ReadFile(ClaimDir(jobDir, shard)/"owner");
+  return owner && *owner == workerName;
+}
+
+static bool Claim(const fs::path& jobDir, size_t shard, std::string_view workerName)
+{
+  const auto temp = jobDir/("claiming-" + std::to_string(shard) + "-" + std::string{workerName});
+  std::error_code ec;
+  fs::create_directory(temp, ec);
+  if (ec || !WriteFile(temp/"owner", std::string{workerName}, workerName))
+    return false;
+
+  //Fails if another worker's claim is already in place
+  fs::rename(temp, ClaimDir(jobDir, shard), ec);
+  if (ec)
+  {
+    fs::remove_all(temp, ec);
+    return false;
+  }
+
+  //Finished while we were claiming it
+  if (fs::exists(DoneFile(jobDir, shard)))
+  {
+    fs::remove_all(ClaimDir(jobDir, shard), ec);
+    return false;
+  }
+  return true;
+}
+
+//Time of the claim's latest checkpoint, or of the claim itself before one
+static std::optional<fs::file_time_type> LastHeartbeat(const fs::path& jobDir, size_t shard)
+{
+  std::error_code ec;
+  auto time = fs::last_write_time(ClaimDir(jobDir, shard)/"checkpoint", ec);
+  if (ec)
+    time = fs::last_write_time(ClaimDir(jobDir, shard)/"owner", ec);
+  return ec ? std::optional<fs::file_time_type>{} : time;
+}
+
+//Claim a shard whose owner has stopped checkpointing, keeping its checkpoint
+static bool TakeOver(const fs::path& jobDir, size_t shard, std::string_view workerName, std::chrono::seconds staleAfter)
+{
+  const auto heartbeat = LastHeartbeat(jobDir, shard);
+  if (!heartbeat || fs::file_time_type::clock::now() - *heartbeat < staleAfter)
+    return false;
+
+  //Only one of the workers taking over at once can move the claim aside
+  const auto temp = jobDir/("claiming-" + std::to_string(shard) + "-" + std::string{workerName});
+  std::error_code ec;
+  fs::remove_all(temp, ec);
+  fs::rename(ClaimDir(jobDir, shard), temp, ec);
+  if (ec)
+    return false;
+
+  //Fails if another worker claimed the shard afresh in the meantime
+  if (!WriteFile(temp/"owner", std::string{workerName}, workerName))
+    ec = std::make_error_code(std::errc::io_error);
+  else
+    fs::rename(temp, ClaimDir(jobDir, shard), ec);
+  if (ec)
+  {
+    fs::remove_all(temp, ec);
+    return false;
+  }
+
+  if (fs::exists(DoneFile(jobDir, shard)))
+  {
+    fs::remove_all(ClaimDir(jobDir, shard), ec);
+    return false;
+  }
+  return true;
+}
+
+//Returns true once the shard is done
+static bool RunShard(const Machine& machine,
+                     const fs::path& jobDir,
+                     const SearchJob& job,
+                     size_t shard,
+                     std::string_view workerName,
+                     const std::atomic<bool>& cancelled,
+                     size_t checkpointEvery)
+{
+  const auto plugBoard = PlugBoard::Create(job.plugs);
+  const auto plainKeys = ToKeys(job.crib);
+  const auto cipherKeys = ToKeys(job.cipherText);
+  if (!plugBoard || !plainKeys || !cipherKeys)
+    return false;
+
+  const auto first = shard*job.shardSize;
+  const auto last = std::min(first + job.shardSize, c_numScramblerKeys);
+  const auto checkpointFile = ClaimDir(jobDir, shard)/"checkpoint";
+
+  TopKeys top{job.topN};
+  auto next = first;
+  if (const auto checkpoint = ReadFile(checkpointFile))
+    next = std::clamp(FromCheckpoint(*checkpoint, top).value_or(first), first, last);
+
+  while (next != last)
+  {
+    const auto end = std::min(next + std::max<size_t>(checkpointEvery, 1), last);
+    next = ScoreCrib(machine, *plugBoard, *plainKeys, *cipherKeys, next, end, top, cancelled);
+    if (!IsOwner(jobDir, shard, workerName)) //Taken over while we were stalled
+      return false;
+    if (!WriteFile(checkpointFile, ToCheckpoint(next, top), workerName) || cancelled)
+      return false;
+  }
+
+  if (!WriteFile(DoneFile(jobDir, shard), ToCheckpoint(last, top), workerName))
+    return false;
+  std::error_code ec;
+  fs::remove_all(ClaimDir(jobDir, shard), ec);
+  return true;
+}
+
+size_t RunSearchWorker(const Machine& machine,
+                       const fs::path& jobDir,
+                       std::string_view workerName,
+                       const std::atomic<bool>& cancelled,
+                       size_t checkpointEvery,
+                       std::chrono::seconds staleAfter)
+{
+  const auto job = LoadSearchJob(jobDir);
+  if (!job)
+    return 0;
+
+  size_t numDone = 0;
+  const auto run = [&](size_t shard)
+  {
+    if (RunShard(machine, jobDir, *job, shard, workerName, cancelled, checkpointEvery))
+      ++numDone;
+  };
+
+  for (size_t shard = 0; shard != job->NumShards() && !cancelled; ++shard)
+    if (!fs::exists(DoneFile(jobDir, shard)) && IsOwner(jobDir, shard, workerName))
+      run(shard);
+
+  for (size_t shard = 0; shard != job->NumShards() && !cancelled; ++shard)
+    if (!fs::exists(DoneFile(jobDir, shard)) && Claim(jobDir, shard, workerName))
+      run(shard);
+
+  for (size_t shard = 0; shard != job->NumShards() && !cancelled; ++shard)
+    if (!fs::exists(DoneFile(jobDir, shard)) && TakeOver(jobDir, shard, workerName, staleAfter))
+      run(shard);
+
+  return numDone;
+}
+
+std::optional<SearchJobResult> MergeSearchJob(const fs::path& jobDir)
+{
+  const auto job = LoadSearchJob(jobDir);
+  if (!job)
+    return {};
+
+  SearchJobResult result;
+  result.numShards = job->NumShards();
+
+  TopKeys top{job->topN};
+  for (size_t shard = 0; shard != result.numShards; ++shard)
+    if (const auto done = ReadFile(DoneFile(jobDir, shard)))
+      if (FromCheckpoint(*done, top))
+        ++result.numDone;
+
+  result.top = top.Keys();
+  return result;
+}
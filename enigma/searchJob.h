@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "search.h"
+
+//Crib search over every scrambler key, split into shards of consecutive keys
+//that separate worker processes claim, checkpoint and finish independently.
+//Kept in a job directory:
+//  job.txt          this SearchJob
+//  shard-<n>.claim/ made by the worker that claims shard n, holding
+//    owner          the worker's name
+//    checkpoint     the next key to score and the top keys so far
+//  shard-<n>.done   the top keys of a finished shard
+//Claims are made by renaming a complete directory into place, and files are
+//replaced by renaming, so a killed worker never leaves a half written file.
+//The checkpoint's modification time is the claim's heartbeat.
+struct SearchJob
+{
+  Plugs plugs;
+  std::string crib;
+  std::string cipherText;
+  size_t shardSize{c_numRingSettings};
+  size_t topN{10};
+
+  size_t NumShards() const;
+};
+
+bool CreateSearchJob(const std::filesystem::path& jobDir, const SearchJob& job);
+std::optional<SearchJob> LoadSearchJob(const std::filesystem::path& jobDir);
+
+//Resumes the shards this worker claimed before, then claims and runs new ones
+//until there are none left or cancelled is set. A worker restarted under the
+//same name after a crash carries on from its last checkpoint, and any worker
+//takes over, from its checkpoint, a claim with no heartbeat for staleAfter.
+//A worker whose claim has been taken over stops at its next checkpoint.
+//Returns the number of shards this call finished.
+size_t RunSearchWorker(const Machine& machine,
+                       const std::filesystem::path& jobDir,
+                       std::string_view workerName,
+                       const std::atomic<bool>& cancelled,
+                       size_t checkpointEvery = 4096,
+                       std::chrono::seconds staleAfter = std::chrono::seconds{60});
+
+struct SearchJobResult
+{
+  size_t numShards{0};
+  size_t numDone{0};
+  std::vector<ScoredKey> top; //Over the finished shards
+};
+std::optional<SearchJobResult> MergeSearchJob(const std::filesystem::path& jobDir);
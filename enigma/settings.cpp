@@ -0,0 +1,167 @@
+#include "pch.h"
+#include "settings.h"
+
+static std::optional<Connections> ToConnections(std::string_view wiring)
+{
+  if (wiring.size() != c_numChars)
+    return {};
+
+  std::array<LeftTerminal, c_numChars> rightToLeft;
+  for (size_t right = 0; right != c_numChars; ++right)
+  {
+    const auto left = Terminal::Create(wiring[right] - 'A');
+    if (!left)
+      return {};
+    rightToLeft[right] = LeftTerminal{*left};
+  }
+  return Connections::Create(std::move(rightToLeft));
+}
+
+static std::optional<CrossConnections> ToCrossConnections(std::string_view wiring)
+{
+  const auto connections = ToConnections(wiring);
+  if (!connections)
+    return {};
+
+  std::array<CrossConnection, c_numCharsBy2> crossConnections;
+  size_t numCrossConnections = 0;
+  for (unsigned char right = 0; right != c_numChars; ++right)
+  {
+    const auto from = LeftTerminal{*Terminal::Create(right)};
+    const auto to = connections->ToLeft(RightTerminal{from.terminal});
+    if (to.terminal.Index() <= right)
+      continue;
+    if (numCrossConnections == crossConnections.size())
+      return {};
+    if (const auto crossConnection = CrossConnection::Create(from, to))
+      crossConnections[numCrossConnections++] = *crossConnection;
+  }
+  if (numCrossConnections != crossConnections.size())
+    return {};
+  return CrossConnections::Create(std::move(crossConnections));
+}
+
+Machine CreateStandardMachine()
+{
+  static const std::array<std::string_view, numMachineWheels> wiring =
+  {
+    "EKMFLGDQVZNTOWYHXUSPAIBRCJ",
+    "AJDKSIRUXBLHWTMCQGZNPYFVOE",
+    "BDFHJLCPRTXVZNYEIWGAKMUSQO",
+    "ESOVPZJAYQUIRHXLNFTGKDCMWB",
+    "VZBRGITYUPSDNHLXAWMJQOFECK",
+  };
+  static const std::string_view turnovers = "QEVJZ";
+  static const std::string_view reflectorB = "YRUHQSLDPXNGOKMIEBFZCWVJAT";
+
+  return Machine{TurnAboutWheel{*ToCrossConnections(reflectorB)},
+                 {Wheel{*ToConnections(wiring[0]), *Key::Create(turnovers[0])},
+                  Wheel{*ToConnections(wiring[1]), *Key::Create(turnovers[1])},
+                  Wheel{*ToConnections(wiring[2]), *Key::Create(turnovers[2])},
+                  Wheel{*ToConnections(wiring[3]), *Key::Create(turnovers[3])},
+                  Wheel{*ToConnections(wiring[4]), *Key::Create(turnovers[4])}}};
+}
+
+std::optional<MachineSettings> ParseSettings(std::string_view wheels,
+                                             std::string_view ringSettings,
+                                             std::string_view plugs)
+{
+  return ParseSettings(wheels, ringSettings, "AAA", plugs);
+}
+
+std::optional<MachineSettings> ParseSettings(std::string_view wheels,
+                                             std::string_view ringSettings,
+                                             std::string_view positions,
+                                             std::string_view plugs)
+{
+  if (wheels.size() != numScramblerRotors ||
+      ringSettings.size() != numScramblerRotors ||
+      positions.size() != numScramblerRotors)
+    return {};
+
+  std::array<std::optional<WheelSelection>, numScramblerRotors> selections;
+  for (size_t rotor = 0; rotor != numScramblerRotors; ++rotor)
+  {
+    const auto wheelIndex = WheelIndex::Create(wheels[rotor] - '0');
+    const auto ringSetting = Key::Create(ringSettings[rotor]);
+    const auto position = Key::Create(positions[rotor]);
+    if (!wheelIndex || !ringSetting || !position)
+      return {};
+    selections[rotor] = WheelSelection{*wheelIndex, *ringSetting, *position};
+  }
+
+  auto plugs_ = ParsePlugs(plugs);
+  if (!plugs_)
+    return {};
+
+  return MachineSettings{{*selections[0], *selections[1], *selections[2]},
+                         std::move(*plugs_)};
+}
+
+std::optional<Plugs> ParsePlugs(std::string_view plugs)
+{
+  Plugs plugs_;
+  if (plugs != "-")
+    for (const auto plug: split(plugs, ','))
+    {
+      const auto lhs = Key::Create(plug.front());
+      const auto rhs = Key::Create(plug.back());
+      if (plug.size() != 2 || !lhs || !rhs)
+        return {};
+      plugs_.push_back(Plug{*lhs, *rhs});
+    }
+  return plugs_;
+}
+
+std::optional<MachineSettings> ParseSettings(std::string_view settings)
+{
+  const auto words = split(settings);
+  if (words.size() == 4)
+    return ParseSettings(words[0], words[1], words[2], words[3]);
+  if (words.size() == 3)
+    return ParseSettings(words[0], words[1], words[2]);
+  return {};
+}
+
+std::string ToString(const MachineSettings& settings)
+{
+  std::string text;
+  for (const auto& selection: settings.selections)
+    text += static_cast<char>('0' + selection.wheelIndex.Value());
+  text += ' ';
+  for (const auto& selection: settings.selections)
+    text += selection.ringSetting.Value();
+  text += ' ';
+  if (std::any_of(settings.selections.cbegin(), settings.selections.cend(), [](const auto& selection){ return selection.position.Index(); }))
+  {
+    for (const auto& selection: settings.selections)
+      text += selection.position.Value();
+    text += ' ';
+  }
+  return text + ToString(settings.plugs);
+}
+
+std::string ToString(const Plugs& plugs)
+{
+  if (plugs.empty())
+    return "-";
+
+  std::string text;
+  for (const auto& plug: plugs)
+  {
+    if (&plug != &plugs.front())
+      text += ',';
+    text += plug.lhs.Value();
+    text += plug.rhs.Value();
+  }
+  return text;
+}
+
+bool Configure(Machine& machine, const MachineSettings& settings)
+{
+  auto plugBoard = PlugBoard::Create(settings.plugs);
+  if (!plugBoard)
+    return false;
+  machine.Configure(settings.selections, std::move(*plugBoard));
+  return true;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "enigma.h"
+
+//Wiring of the Enigma I wheels I-V and reflector B
+Machine CreateStandardMachine();
+
+//Daily key: which wheels go in which slot, their ring settings and the plugs
+struct MachineSettings
+{
+  std::array<WheelSelection, numScramblerRotors> selections;
+  Plugs plugs;
+};
+
+//Text form is wheels, ring settings, optional start positions (default "AAA")
+//and plugs e.g. "012 AAA AB,CD" or "012 AAA QEV AB,CD" (use "-" for no plugs)
+std::optional<MachineSettings> ParseSettings(std::string_view wheels,
+                                             std::string_view ringSettings,
+                                             std::string_view plugs);
+std::optional<MachineSettings> ParseSettings(std::string_view wheels,
+                                             std::string_view ringSettings,
+                                             std::string_view positions,
+                                             std::string_view plugs);
+std::optional<MachineSettings> ParseSettings(std::string_view settings);
+std::optional<Plugs> ParsePlugs(std::string_view plugs);
+std::string ToString(const MachineSettings& settings);
+std::string ToString(const Plugs& plugs);
+
+bool Configure(Machine& machine, const MachineSettings& settings);
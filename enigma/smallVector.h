@@ -0,0 +1,163 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <initializer_list>
+#include <memory_resource>
+#include <type_traits>
+
+//Vector that holds up to numInline elements without a heap allocation.
+//Limited to trivially copyable T, which covers the fixed size arrays used for
+//callsigns and the like.
+//Takes a polymorphic allocator, as std::pmr containers do, so elements beyond
+//numInline can live in an Arena. With the allocator it is as big as a
+//std::vector (24 bytes on 64 bit platforms); the saving is the heap block,
+//and its bookkeeping, that a vector needs for even one element.
+template <typename T, size_t numInline>
+class SmallVector
+{
+  static_assert(std::is_trivially_copyable_v<T> && std::is_default_constructible_v<T>);
+
+public:
+  using allocator_type = std::pmr::polymorphic_allocator<T>;
+private:
+  uint32_t size_{0};
+  uint32_t capacity_{numInline};
+  allocator_type allocator_;
+  union
+  {
+    T inline_[numInline];
+    T* heap_;
+  };
+
+  bool IsInline_() const
+  {
+    return capacity_ == numInline;
+  }
+  void Free_()
+  {
+    if (!IsInline_())
+      allocator_.deallocate(heap_, capacity_);
+  }
+  void Steal_(SmallVector& other)
+  {
+    Free_();
+    heap_ = other.heap_;
+    capacity_ = other.capacity_;
+    size_ = other.size_;
+    other.capacity_ = numInline;
+    other.size_ = 0;
+  }
+public:
+  using value_type = T;
+  using size_type = size_t;
+  using iterator = T*;
+  using const_iterator = const T*;
+
+  SmallVector(): inline_{} {}
+  explicit SmallVector(const allocator_type& allocator): allocator_{allocator}, inline_{} {}
+  SmallVector(std::initializer_list<T> items, const allocator_type& allocator = {}): SmallVector{allocator}
+  {
+    reserve(items.size());
+    std::copy(items.begin(), items.end(), begin());
+    size_ = static_cast<uint32_t>(items.size());
+  }
+  //Copies get the default allocator, as std::pmr containers' do
+  SmallVector(const SmallVector& other): SmallVector{}
+  {
+    *this = other;
+  }
+  SmallVector(const SmallVector& other, const allocator_type& allocator): SmallVector{allocator}
+  {
+    *this = other;
+  }
+  SmallVector(SmallVector&& other) noexcept: SmallVector{other.allocator_}
+  {
+    *this = std::move(other);
+  }
+  ~SmallVector()
+  {
+    Free_();
+  }
+
+  SmallVector& operator=(const SmallVector& other)
+  {
+    if (this != &other)
+    {
+      clear();
+      reserve(other.size());
+      std::copy(other.begin(), other.end(), begin());
+      size_ = other.size_;
+    }
+    return *this;
+  }
+  //Takes over other's elements if they share an allocator, else copies them
+  SmallVector& operator=(SmallVector&& other)
+  {
+    if (this == &other)
+      return *this;
+    if (!other.IsInline_() && allocator_ == other.allocator_)
+    {
+      Steal_(other);
+      return *this;
+    }
+
+    clear();
+    reserve(other.size());
+    std::copy(other.begin(), other.end(), begin());
+    size_ = other.size_;
+    other.clear();
+    return *this;
+  }
+
+  allocator_type get_allocator() const { return allocator_; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  size_t capacity() const { return capacity_; }
+
+  void reserve(size_t capacity)
+  {
+    if (capacity <= capacity_)
+      return;
+    auto heap = allocator_.allocate(capacity);
+    std::copy(begin(), end(), heap);
+    Free_();
+    heap_ = heap;
+    capacity_ = static_cast<uint32_t>(capacity);
+  }
+  void clear() { size_ = 0; }
+
+  void push_back(const T& item)
+  {
+    if (size_ == capacity_)
+    {
+      const auto copy = item; //item may be one of ours
+      reserve(2*capacity_);
+      data()[size_++] = copy;
+      return;
+    }
+    data()[size_++] = item;
+  }
+  void pop_back() { --size_; }
+
+  T* data() { return IsInline_() ? inline_ : heap_; }
+  const T* data() const { return IsInline_() ? inline_ : heap_; }
+  T& operator[](size_t index) { return data()[index]; }
+  const T& operator[](size_t index) const { return data()[index]; }
+  T& front() { return data()[0]; }
+  const T& front() const { return data()[0]; }
+  T& back() { return data()[size_ - 1]; }
+  const T& back() const { return data()[size_ - 1]; }
+
+  iterator begin() { return data(); }
+  iterator end() { return data() + size_; }
+  const_iterator begin() const { return data(); }
+  const_iterator end() const { return data() + size_; }
+  const_iterator cbegin() const { return begin(); }
+  const_iterator cend() const { return end(); }
+
+  bool operator==(const SmallVector& other) const
+  {
+    return std::equal(begin(), end(), other.begin(), other.end());
+  }
+};
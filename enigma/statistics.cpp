@@ -0,0 +1,233 @@
+#include "pch.h"
+#include <algorithm>
+#include <numeric>
+#include <thread>
+#include "statistics.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ENIGMA_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+  constexpr size_t c_blockSize = 16;
+  constexpr size_t c_numBuckets = 4; //Tables a letter count is spread over
+  constexpr size_t c_notLetter = c_numChars;
+
+  //Letter counts spread over interleaved tables, the next letter going to
+  //the next table, then summed. 64 bit so a whole corpus can't wrap them.
+  class LetterCounter
+  {
+    std::array<std::array<uint64_t, c_numChars>, c_numBuckets> buckets_{};
+    size_t next_{0};
+  public:
+    void Add(size_t index)
+    {
+      ++buckets_[next_++ % c_numBuckets][index];
+    }
+    void Add4(const unsigned char* indexes)
+    {
+      ++buckets_[0][indexes[0]];
+      ++buckets_[1][indexes[1]];
+      ++buckets_[2][indexes[2]];
+      ++buckets_[3][indexes[3]];
+    }
+    LetterCounts Counts() const
+    {
+      LetterCounts counts{};
+      for (const auto& bucket: buckets_)
+        for (size_t letter = 0; letter != c_numChars; ++letter)
+          counts[letter] += bucket[letter];
+      return counts;
+    }
+  };
+
+  //One table: with 676 pairs the same one rarely comes twice running, so
+  //interleaving would only add the cost of the extra tables
+  class BigramCounter
+  {
+    std::array<uint64_t, c_numChars*c_numChars> counts_{};
+    size_t previous_{c_notLetter};
+  public:
+    void Add(size_t index)
+    {
+      if (previous_ != c_notLetter && index != c_notLetter)
+        ++counts_[previous_*c_numChars + index];
+      previous_ = index;
+    }
+    BigramCounts Counts() const
+    {
+      BigramCounts counts;
+      std::copy(counts_.cbegin(), counts_.cend(), counts.begin());
+      return counts;
+    }
+  };
+
+  size_t ToIndex(char c)
+  {
+    return (c >= 'A' && c <= 'Z') ? static_cast<size_t>(c - 'A') : c_notLetter;
+  }
+
+  //Calls onBlock with the indexes of each 16 letters with nothing else
+  //between them, and onChar with the index, or c_notLetter, of the rest
+  template <typename TBlock, typename TChar>
+  void ForEachIndex(std::string_view text, TBlock onBlock, TChar onChar)
+  {
+    size_t pos = 0;
+#ifdef ENIGMA_SSE2
+    const auto upperA = _mm_set1_epi8('A' - 1);
+    const auto upperZ = _mm_set1_epi8('Z' + 1);
+    const auto a = _mm_set1_epi8('A');
+    alignas(c_blockSize) unsigned char indexes[c_blockSize];
+
+    for (; pos + c_blockSize <= text.size(); pos += c_blockSize)
+    {
+      const auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text.data() + pos));
+      const auto isLetter = _mm_and_si128(_mm_cmpgt_epi8(block, upperA), _mm_cmplt_epi8(block, upperZ));
+      if (_mm_movemask_epi8(isLetter) != 0xFFFF)
+      {
+        for (size_t i = 0; i != c_blockSize; ++i)
+          onChar(ToIndex(text[pos + i]));
+        continue;
+      }
+      _mm_store_si128(reinterpret_cast<__m128i*>(indexes), _mm_sub_epi8(block, a));
+      onBlock(indexes);
+    }
+#endif
+    for (; pos != text.size(); ++pos)
+      onChar(ToIndex(text[pos]));
+  }
+}
+
+LetterCounts CountLetters(std::string_view text)
+{
+  LetterCounter counter;
+  ForEachIndex(text, [&counter](const unsigned char* indexes)
+  {
+    for (size_t i = 0; i != c_blockSize; i += c_numBuckets)
+      counter.Add4(indexes + i);
+  },
+  [&counter](size_t index)
+  {
+    if (index != c_notLetter)
+      counter.Add(index);
+  });
+  return counter.Counts();
+}
+
+LetterCounts CountLetters(const EncipheredText& text)
+{
+  LetterCounter counter;
+  text.ForEachIndex([&counter](size_t index){ counter.Add(index); });
+  return counter.Counts();
+}
+
+BigramCounts CountBigrams(std::string_view text)
+{
+  BigramCounter counter;
+  ForEachIndex(text, [&counter](const unsigned char* indexes)
+  {
+    for (size_t i = 0; i != c_blockSize; ++i)
+      counter.Add(indexes[i]);
+  },
+  [&counter](size_t index){ counter.Add(index); });
+  return counter.Counts();
+}
+
+BigramCounts CountBigrams(const EncipheredText& text)
+{
+  BigramCounter counter;
+  text.ForEachIndex([&counter](size_t index){ counter.Add(index); });
+  return counter.Counts();
+}
+
+const LanguageModel& GermanLanguageModel()
+{
+  static const auto model = []
+  {
+    //Percentages A-Z
+    LanguageModel model{{6.51, 1.89, 3.06, 5.08, 17.40, 1.66, 3.01, 4.76, 7.55, 0.27, 1.21, 3.44, 2.53,
+                         9.78, 2.51, 0.79, 0.02, 7.00, 7.27, 6.15, 4.35, 0.67, 1.89, 0.03, 0.04, 1.13}};
+    const auto total = std::accumulate(model.letterFrequencies.cbegin(), model.letterFrequencies.cend(), 0.0);
+    for (auto& frequency: model.letterFrequencies)
+      frequency /= total;
+    return model;
+  }();
+  return model;
+}
+
+double ChiSquared(const LetterCounts& counts, const LanguageModel& model)
+{
+  const auto numLetters = static_cast<double>(std::accumulate(counts.cbegin(), counts.cend(), uint64_t{0}));
+  double chiSquared = 0;
+  if (numLetters == 0)
+    return chiSquared;
+  for (size_t letter = 0; letter != c_numChars; ++letter)
+  {
+    const auto expected = numLetters*model.letterFrequencies[letter];
+    const auto difference = static_cast<double>(counts[letter]) - expected;
+    chiSquared += difference*difference/expected;
+  }
+  return chiSquared;
+}
+
+static size_t ToIndex(const std::array<TextChar, 3>& letters)
+{
+  return (letters[0].Index()*c_numChars + letters[1].Index())*c_numChars + letters[2].Index();
+}
+
+bool operator<(const TrafficKey& lhs, const TrafficKey& rhs)
+{
+  return std::pair{ToIndex(lhs.from), ToIndex(lhs.discriminant)} < std::pair{ToIndex(rhs.from), ToIndex(rhs.discriminant)};
+}
+
+std::map<TrafficKey, TrafficStatistics> AggregateTraffic(const std::vector<EnigmaMessage>& messages,
+                                                         size_t numThreads)
+{
+  numThreads = std::max<size_t>(std::min(numThreads, messages.size()), 1);
+
+  std::vector<std::map<TrafficKey, TrafficStatistics>> slices(numThreads);
+  {
+    std::vector<std::thread> workers;
+    for (size_t thread = 0; thread != numThreads; ++thread)
+      workers.emplace_back([&, thread]
+      {
+        const auto first = messages.size()*thread/numThreads;
+        const auto last = messages.size()*(thread + 1)/numThreads;
+        auto& traffic = slices[thread];
+        for (auto message = first; message != last; ++message)
+        {
+          const auto& [interception, preamble, encipheredText] = messages[message];
+          auto& statistics = traffic[TrafficKey{preamble.from, preamble.discriminant}];
+          ++statistics.numMessages;
+
+          //Bigrams straight into the totals, as clearing a table a message would cost more than the counting
+          LetterCounter letters;
+          auto previous = c_notLetter;
+          encipheredText.ForEachIndex([&](size_t index)
+          {
+            letters.Add(index);
+            if (previous != c_notLetter)
+              ++statistics.bigrams[previous*c_numChars + index];
+            previous = index;
+          });
+          const auto letterCounts = letters.Counts();
+          std::transform(letterCounts.cbegin(), letterCounts.cend(), statistics.letters.cbegin(), statistics.letters.begin(), std::plus{});
+        }
+      });
+    for (auto& worker: workers)
+      worker.join();
+  }
+
+  auto traffic = std::move(slices.front());
+  for (auto slice = std::next(slices.begin()); slice != slices.end(); ++slice)
+    for (const auto& [key, statistics]: *slice)
+    {
+      auto& merged = traffic[key];
+      merged.numMessages += statistics.numMessages;
+      std::transform(statistics.letters.cbegin(), statistics.letters.cend(), merged.letters.cbegin(), merged.letters.begin(), std::plus{});
+      std::transform(statistics.bigrams.cbegin(), statistics.bigrams.cend(), merged.bigrams.cbegin(), merged.bigrams.begin(), std::plus{});
+    }
+  return traffic;
+}
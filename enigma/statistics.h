@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string_view>
+#include <vector>
+
+#include "enigma.h"
+
+using LetterCounts = std::array<uint64_t, c_numChars>;
+using BigramCounts = std::array<uint64_t, c_numChars*c_numChars>; //First letter*c_numChars + second
+
+//Counts of the letters 'A'-'Z' and of pairs of them next to each other;
+//anything else in text is skipped and breaks a pair.
+//Letters are checked 16 at a time with SSE2 where available and counted into
+//interleaved tables, so repeated letters don't wait on each other's stores.
+LetterCounts CountLetters(std::string_view text);
+LetterCounts CountLetters(const EncipheredText& text);
+BigramCounts CountBigrams(std::string_view text);
+BigramCounts CountBigrams(const EncipheredText& text);
+
+//Expected share of each letter in plain text
+struct LanguageModel
+{
+  std::array<double, c_numChars> letterFrequencies; //Sum to 1
+};
+const LanguageModel& GermanLanguageModel();
+
+//Lower is closer to the model; 0 for no letters
+double ChiSquared(const LetterCounts& counts, const LanguageModel& model);
+
+//Traffic of one sending station on one key
+struct TrafficKey
+{
+  Callsign from;
+  Discriminant discriminant;
+};
+bool operator<(const TrafficKey& lhs, const TrafficKey& rhs);
+
+struct TrafficStatistics
+{
+  size_t numMessages{0};
+  LetterCounts letters{};
+  BigramCounts bigrams{};
+};
+
+//Statistics of the enciphered text of messages, grouped by sender and
+//discriminant, counted over numThreads slices of messages and then merged
+std::map<TrafficKey, TrafficStatistics> AggregateTraffic(const std::vector<EnigmaMessage>& messages,
+                                                         size_t numThreads);
@@ -0,0 +1,250 @@
+#include "pch.h"
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include "search.h"
+#include "testVectors.h"
+
+namespace
+{
+  constexpr std::string_view c_magic = "ENIGMATV";
+  constexpr uint32_t c_version = 1;
+  constexpr size_t c_vectorsPerChunk = 4096;
+  constexpr size_t c_maxPlugs = 10;
+  constexpr size_t c_maxLength = 250;
+
+  //The SplitMix64 finaliser
+  uint64_t Mix(uint64_t z)
+  {
+    z = (z ^ (z >> 30))*0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27))*0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+  }
+
+  //SplitMix64, so each vector has its own stream and the standard
+  //distributions, which differ between libraries, aren't needed.
+  //Seed and index are mixed before they start the stream; the stream adds
+  //the same constant each draw, so starting it from a multiple of that
+  //constant made each vector's stream its neighbour's a draw later.
+  class Random
+  {
+    uint64_t state_;
+  public:
+    Random(uint64_t seed, size_t index): state_{Mix(Mix(seed) ^ index)} {}
+    uint64_t operator()()
+    {
+      return Mix(state_ += 0x9E3779B97F4A7C15ull);
+    }
+    size_t Below(size_t num)
+    {
+      return static_cast<size_t>((*this)() % num);
+    }
+  };
+
+  void Put(std::string& bytes, uint64_t value, size_t numBytes)
+  {
+    for (size_t i = 0; i != numBytes; ++i)
+      bytes += static_cast<char>((value >> (8*i)) & 0xFF);
+  }
+
+  std::optional<uint64_t> Get(std::istream& in, size_t numBytes)
+  {
+    unsigned char bytes[8];
+    if (!in.read(reinterpret_cast<char*>(bytes), static_cast<std::streamsize>(numBytes)))
+      return {};
+    uint64_t value = 0;
+    for (size_t i = 0; i != numBytes; ++i)
+      value |= uint64_t{bytes[i]} << (8*i);
+    return value;
+  }
+
+  void Encode(std::string& bytes, const TestVector& vector)
+  {
+    for (const auto& selection: vector.settings.selections)
+      bytes += static_cast<char>(selection.wheelIndex.Index());
+    for (const auto& selection: vector.settings.selections)
+      bytes += static_cast<char>(selection.ringSetting.Index());
+    for (const auto& selection: vector.settings.selections)
+      bytes += static_cast<char>(selection.position.Index());
+    bytes += static_cast<char>(vector.settings.plugs.size());
+    for (const auto& plug: vector.settings.plugs)
+    {
+      bytes += static_cast<char>(plug.lhs.Index());
+      bytes += static_cast<char>(plug.rhs.Index());
+    }
+    Put(bytes, vector.keys.size(), 2);
+    for (const auto key: vector.keys)
+      bytes += static_cast<char>(key - 'A');
+    for (const auto lamp: vector.lamps)
+      bytes += static_cast<char>(lamp - 'A');
+  }
+
+  std::optional<std::string> DecodeText(std::istream& in, size_t length)
+  {
+    std::string text(length, '\0');
+    if (!in.read(text.data(), static_cast<std::streamsize>(length)))
+      return {};
+    for (auto& c: text)
+    {
+      const auto key = Key::Create('A' + c);
+      if (!key)
+        return {};
+      c = key->Value();
+    }
+    return text;
+  }
+
+  std::optional<TestVector> Decode(std::istream& in)
+  {
+    unsigned char selections[3*numScramblerRotors];
+    if (!in.read(reinterpret_cast<char*>(selections), sizeof(selections)))
+      return {};
+
+    std::array<std::optional<WheelSelection>, numScramblerRotors> selections_;
+    for (size_t rotor = 0; rotor != numScramblerRotors; ++rotor)
+    {
+      const auto wheelIndex = WheelIndex::Create(selections[rotor]);
+      const auto ringSetting = Key::Create('A' + selections[numScramblerRotors + rotor]);
+      const auto position = Key::Create('A' + selections[2*numScramblerRotors + rotor]);
+      if (!wheelIndex || !ringSetting || !position)
+        return {};
+      selections_[rotor] = WheelSelection{*wheelIndex, *ringSetting, *position};
+    }
+    TestVector vector{MachineSettings{{*selections_[0], *selections_[1], *selections_[2]}, {}}, {}, {}};
+
+    const auto numPlugs = Get(in, 1);
+    if (!numPlugs || *numPlugs > c_numCharsBy2)
+      return {};
+    for (size_t plug = 0; plug != *numPlugs; ++plug)
+    {
+      const auto ends = DecodeText(in, 2);
+      if (!ends)
+        return {};
+      vector.settings.plugs.push_back(Plug{*Key::Create((*ends)[0]), *Key::Create((*ends)[1])});
+    }
+
+    const auto length = Get(in, 2);
+    if (!length)
+      return {};
+    auto keys = DecodeText(in, *length);
+    auto lamps = DecodeText(in, *length);
+    if (!keys || !lamps)
+      return {};
+    vector.keys = std::move(*keys);
+    vector.lamps = std::move(*lamps);
+    return vector;
+  }
+}
+
+TestVector GenerateTestVector(uint64_t seed, size_t index)
+{
+  Random random{seed, index};
+
+  const auto& wheelOrder = WheelOrders()[random.Below(c_numWheelOrders)];
+  const auto selection = [&](size_t rotor)
+  {
+    const auto ringSetting = Key{} + static_cast<int>(random.Below(c_numChars));
+    const auto position = Key{} + static_cast<int>(random.Below(c_numChars));
+    return WheelSelection{wheelOrder[rotor], ringSetting, position};
+  };
+  //Braced initialisers are evaluated in order, so the stream is the same everywhere
+  TestVector vector{MachineSettings{{selection(0), selection(1), selection(2)}, {}}, {}, {}};
+
+  //Plugs from a shuffle of the letters, so no letter has two
+  std::array<Key, c_numChars> letters;
+  for (size_t letter = 0; letter != c_numChars; ++letter)
+    letters[letter] = Key{} + static_cast<int>(letter);
+  for (size_t letter = c_numChars - 1; letter != 0; --letter)
+    std::swap(letters[letter], letters[random.Below(letter + 1)]);
+  const auto numPlugs = random.Below(c_maxPlugs + 1);
+  for (size_t plug = 0; plug != numPlugs; ++plug)
+    vector.settings.plugs.push_back(Plug{letters[2*plug], letters[2*plug + 1]});
+
+  vector.keys.resize(1 + random.Below(c_maxLength));
+  for (auto& key: vector.keys)
+    key = static_cast<char>('A' + random.Below(c_numChars));
+
+  static const auto standardMachine = CreateStandardMachine();
+  auto m = standardMachine;
+  Configure(m, vector.settings);
+  m.ToLamp(vector.keys, vector.lamps);
+  return vector;
+}
+
+bool WriteTestVectors(std::ostream& out, uint64_t seed, size_t numVectors, size_t numThreads)
+{
+  numThreads = std::max<size_t>(numThreads, 1);
+
+  std::string header{c_magic};
+  Put(header, c_version, 4);
+  Put(header, seed, 8);
+  Put(header, numVectors, 8);
+  out.write(header.data(), static_cast<std::streamsize>(header.size()));
+
+  //Each round encodes a chunk of vectors a thread, written out in order
+  std::vector<std::string> chunks(numThreads);
+  for (size_t first = 0; first < numVectors && out; first += numThreads*c_vectorsPerChunk)
+  {
+    std::vector<std::thread> workers;
+    for (size_t thread = 0; thread != numThreads; ++thread)
+      workers.emplace_back([&, thread]
+      {
+        auto& chunk = chunks[thread];
+        chunk.clear();
+        const auto begin = std::min(numVectors, first + thread*c_vectorsPerChunk);
+        const auto end = std::min(numVectors, begin + c_vectorsPerChunk);
+        for (auto index = begin; index != end; ++index)
+          Encode(chunk, GenerateTestVector(seed, index));
+      });
+    for (auto& worker: workers)
+      worker.join();
+
+    for (const auto& chunk: chunks)
+      out.write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+  }
+
+  out.flush();
+  return static_cast<bool>(out);
+}
+
+Engine ReferenceEngine()
+{
+  return [standardMachine = CreateStandardMachine(), m = CreateStandardMachine()](const MachineSettings& settings, std::string_view keys) mutable
+  {
+    m = standardMachine;
+    if (!Configure(m, settings))
+      return std::string{};
+    return m.ToLamp(keys);
+  };
+}
+
+std::optional<VerifyResult> VerifyTestVectors(std::istream& in, const Engine& engine)
+{
+  std::string magic(c_magic.size(), '\0');
+  if (!in.read(magic.data(), static_cast<std::streamsize>(magic.size())) || magic != c_magic)
+    return {};
+  const auto version = Get(in, 4);
+  const auto seed = Get(in, 8);
+  const auto numVectors = Get(in, 8);
+  if (!version || *version != c_version || !seed || !numVectors)
+    return {};
+
+  VerifyResult result;
+  while (result.numVectors != *numVectors)
+  {
+    auto vector = Decode(in);
+    if (!vector)
+      return {};
+    ++result.numVectors;
+
+    auto lamps = engine(vector->settings, vector->keys);
+    if (lamps != vector->lamps)
+    {
+      const auto mismatch = std::mismatch(vector->lamps.cbegin(), vector->lamps.cend(), lamps.cbegin(), lamps.cend());
+      const auto position = static_cast<size_t>(mismatch.first - vector->lamps.cbegin());
+      result.divergence = Divergence{result.numVectors - 1, position, std::move(*vector), std::move(lamps)};
+      break;
+    }
+  }
+  return result;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+#include "settings.h"
+
+//Known answers from Machine::ToLamp on the standard machine, for checking
+//faster engines against: random settings and text, reproducible from a seed.
+struct TestVector
+{
+  MachineSettings settings;
+  std::string keys;
+  std::string lamps;
+};
+
+//The index'th vector of seed, whichever thread or platform makes it
+TestVector GenerateTestVector(uint64_t seed, size_t index);
+
+//Writes numVectors from seed, generated on numThreads, to a binary file:
+//a header then, per vector, wheels, rings, positions, plugs and the keys and
+//lamps a letter a byte. Returns false if out fails.
+bool WriteTestVectors(std::ostream& out, uint64_t seed, size_t numVectors, size_t numThreads);
+
+//Any way of enciphering keys from settings on the standard machine
+using Engine = std::function<std::string(const MachineSettings& settings, std::string_view keys)>;
+Engine ReferenceEngine();
+
+struct Divergence
+{
+  size_t vector{0};
+  size_t position{0}; //First lamp that differs, or the shorter length
+  TestVector expected;
+  std::string lamps;
+};
+
+struct VerifyResult
+{
+  size_t numVectors{0}; //Checked, up to and including any divergence
+  std::optional<Divergence> divergence;
+};
+
+//Replays each vector of in through engine, stopping at the first divergence.
+//Empty if in is not a test vector file.
+std::optional<VerifyResult> VerifyTestVectors(std::istream& in, const Engine& engine);
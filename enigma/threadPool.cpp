@@ -0,0 +1,58 @@
+#include "pch.h"
+#include <algorithm>
+#include "threadPool.h"
+
+PriorityThreadPool::PriorityThreadPool(size_t numThreads, size_t numReserved)
+{
+  numThreads = std::max<size_t>(numThreads, numReserved + 1);
+  for (size_t i = 0; i != numThreads; ++i)
+    threads_.emplace_back([this, reserved = i < numReserved]
+    {
+      Run_(reserved ? Priority::Interactive : Priority::Background);
+    });
+}
+
+PriorityThreadPool::~PriorityThreadPool()
+{
+  {
+    std::lock_guard lock{mutex_};
+    stopping_ = true;
+  }
+  wake_.notify_all();
+  for (auto& thread: threads_)
+    thread.join();
+}
+
+void PriorityThreadPool::Submit(Priority priority, Task task)
+{
+  {
+    std::lock_guard lock{mutex_};
+    queues_[static_cast<size_t>(priority)].push_back(std::move(task));
+  }
+  wake_.notify_all();
+}
+
+void PriorityThreadPool::Run_(Priority lowest)
+{
+  const auto queuesBegin = queues_.begin();
+  const auto queuesEnd = queuesBegin + static_cast<size_t>(lowest) + 1;
+
+  for (;;)
+  {
+    Task task;
+    {
+      std::unique_lock lock{mutex_};
+      auto queue = queuesEnd;
+      wake_.wait(lock, [&]
+      {
+        queue = std::find_if(queuesBegin, queuesEnd, [](const auto& q){ return !q.empty(); });
+        return queue != queuesEnd || stopping_;
+      });
+      if (queue == queuesEnd)
+        return;
+      task = std::move(queue->front());
+      queue->pop_front();
+    }
+    task();
+  }
+}
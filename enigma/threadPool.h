@@ -0,0 +1,40 @@
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+enum class Priority : unsigned char
+{
+  Interactive, //Quick encipher/decipher requests
+  Batch,
+  Background,  //Long running key searches
+};
+static constexpr size_t c_numPriorities = 3;
+
+//Runs the highest priority queued task first.
+//The first numReserved threads only take Interactive tasks so that quick
+//requests are never stuck behind a pool full of long searches.
+class PriorityThreadPool
+{
+  using Task = std::function<void()>;
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::array<std::deque<Task>, c_numPriorities> queues_;
+  bool stopping_{false};
+  std::vector<std::thread> threads_;
+
+  void Run_(Priority lowest);
+public:
+  PriorityThreadPool(size_t numThreads, size_t numReserved = 1);
+  ~PriorityThreadPool(); //Finishes queued tasks before returning
+  PriorityThreadPool(const PriorityThreadPool&) = delete;
+  PriorityThreadPool& operator=(const PriorityThreadPool&) = delete;
+
+  void Submit(Priority priority, Task task);
+};
@@ -2,6 +2,8 @@
 
 #include <algorithm>
 #include <memory>
+#include <string_view>
+#include <vector>
 
 template <typename T, T begin_, size_t num_>
 class IntRange
@@ -48,7 +50,7 @@ public:
   }
   [[nodiscard]] IntRange operator+(int inc) const
   {
-    return static_cast<T>((value_ + inc + num_) % num_);
+    return static_cast<T>(begin_ + (value_ - begin_ + inc + num_) % num_);
   };
 
 };
@@ -97,4 +99,17 @@ auto to_array(const std::array<T,num>& arrIn, const TFnc fnc) -> std::array<decl
   std::array<decltype(fnc(arrIn.front())), num> arrOut;
   std::transform(arrIn.cbegin(), arrIn.cend(), arrOut.begin(), fnc);
   return arrOut;
-}
\ No newline at end of file
+}
+
+inline std::vector<std::string_view> split(std::string_view text, char separator = ' ')
+{
+  std::vector<std::string_view> words;
+  while (!text.empty())
+  {
+    const auto end = std::min(text.find(separator), text.size());
+    if (end)
+      words.push_back(text.substr(0, end));
+    text.remove_prefix(std::min(end + 1, text.size()));
+  }
+  return words;
+}
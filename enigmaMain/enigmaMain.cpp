@@ -1,20 +1,226 @@
 // enigmaMain.cpp : This file contains the 'main' function. Program execution begins and ends there.
 //
 
+#include <charconv>
+#include <fstream>
 #include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
 
-int main()
+#include "batch.h"
+#include "jobService.h"
+#include "keystream.h"
+#include "searchJob.h"
+#include "testVectors.h"
+
+//The whole of text as a number, or empty
+template <typename T>
+static std::optional<T> ToNumber(std::string_view text)
+{
+  T value{};
+  const auto end = text.data() + text.size();
+  const auto [ptr, error] = std::from_chars(text.data(), end, value);
+  if (error != std::errc{} || ptr != end)
+    return {};
+  return value;
+}
+
+//Serve requests, one per line, until end of input or "quit".
+//Each request gets a single line reply, see JobService for the protocol.
+static int Serve(std::istream& in, std::ostream& out)
+{
+  JobService service{CreateStandardMachine(), std::thread::hardware_concurrency()};
+
+  for (std::string request; std::getline(in, request) && request != "quit";)
+    out << service.Handle(request) << std::endl;
+
+  return 0;
+}
+
+//Encipher stdin to stdout, a message per line, all from the same settings:
+//wheels, ring settings, optional start positions and plugs
+static int Batch(const std::vector<std::string_view>& words, size_t numThreads)
+{
+  const auto settings = words.size() == 4 ? ParseSettings(words[0], words[1], words[2], words[3])
+                                          : ParseSettings(words[0], words[1], words[2]);
+  auto machine = CreateStandardMachine();
+  if (!settings || !Configure(machine, *settings))
+  {
+    std::cerr << "bad settings\n";
+    return 1;
+  }
+
+  std::ios::sync_with_stdio(false);
+  EncipherLines(machine, std::cin, std::cout, numThreads);
+  return 0;
+}
+
+//Crib search shared between worker processes through a job directory
+static int SearchJobCommand(std::string_view command, const std::vector<std::string_view>& args)
+{
+  if (command == "--search-create" && (args.size() == 4 || args.size() == 6))
+  {
+    SearchJob job;
+    if (args.size() == 6)
+    {
+      const auto shardSize = ToNumber<size_t>(args[4]);
+      const auto topN = ToNumber<size_t>(args[5]);
+      if (!shardSize || !topN)
+        return -1;
+      job.shardSize = *shardSize;
+      job.topN = *topN;
+    }
+    auto plugs = ParsePlugs(args[1]);
+    if (!plugs)
+    {
+      std::cerr << "bad plugs\n";
+      return 1;
+    }
+    job.plugs = std::move(*plugs);
+    job.crib = args[2];
+    job.cipherText = args[3];
+    if (!CreateSearchJob(args[0], job))
+    {
+      std::cerr << "can't create search job\n";
+      return 1;
+    }
+    std::cout << job.NumShards() << " shards\n";
+    return 0;
+  }
+
+  if (command == "--search-work" && (args.size() == 2 || args.size() == 3))
+  {
+    const auto staleSeconds = args.size() == 3 ? ToNumber<size_t>(args[2]) : 60;
+    if (!staleSeconds)
+      return -1;
+    const std::atomic<bool> cancelled{false};
+    std::cout << RunSearchWorker(CreateStandardMachine(), args[0], args[1], cancelled,
+                                 4096, std::chrono::seconds{*staleSeconds}) << " shards done\n";
+    return 0;
+  }
+
+  if (command == "--search-merge" && args.size() == 1)
+  {
+    const auto job = LoadSearchJob(args[0]);
+    const auto result = MergeSearchJob(args[0]);
+    if (!job || !result)
+    {
+      std::cerr << "can't read search job\n";
+      return 1;
+    }
+    std::cout << result->numDone << " of " << result->numShards << " shards done\n";
+    for (const auto& key: result->top)
+      std::cout << key.score << ' ' << ToString(MachineSettings{ToSelections(key.scramblerKey), job->plugs}) << '\n';
+    return 0;
+  }
+
+  return -1;
+}
+
+//Known answer vectors from the reference machine, and checking engines against them
+static int TestVectorsCommand(std::string_view command, const std::vector<std::string_view>& args)
 {
-    std::cout << "Hello World!\n";
+  if (command == "--vectors-generate" && args.size() >= 2 && args.size() <= 4)
+  {
+    const auto numVectors = ToNumber<size_t>(args[1]);
+    const auto seed = args.size() >= 3 ? ToNumber<uint64_t>(args[2]) : 0;
+    const auto numThreads = args.size() == 4 ? ToNumber<size_t>(args[3]) : std::thread::hardware_concurrency();
+    if (!numVectors || !seed || !numThreads)
+      return -1;
+    std::ofstream out{std::string{args[0]}, std::ios::binary};
+    if (!WriteTestVectors(out, *seed, *numVectors, *numThreads))
+    {
+      std::cerr << "can't write test vectors\n";
+      return 1;
+    }
+    return 0;
+  }
+
+  if (command == "--vectors-verify" && (args.size() == 1 || args.size() == 2))
+  {
+    const auto engineName = args.size() == 2 ? args[1] : "reference";
+    Engine engine;
+    if (engineName == "reference")
+      engine = ReferenceEngine();
+    else if (engineName == "keystream")
+      engine = [standardMachine = CreateStandardMachine()](const MachineSettings& settings, std::string_view keys)
+      {
+        auto m = standardMachine;
+        Configure(m, settings);
+        return Keystream{m}.ToLamp(keys);
+      };
+    else
+    {
+      std::cerr << "unknown engine\n";
+      return 1;
+    }
+
+    std::ifstream in{std::string{args[0]}, std::ios::binary};
+    const auto result = VerifyTestVectors(in, engine);
+    if (!result)
+    {
+      std::cerr << "can't read test vectors\n";
+      return 1;
+    }
+    if (const auto& divergence = result->divergence)
+    {
+      std::cout << "vector " << divergence->vector << " diverges at " << divergence->position
+                << ": " << ToString(divergence->expected.settings) << ' ' << divergence->expected.keys << '\n'
+                << "  expected " << divergence->expected.lamps << '\n'
+                << "  actual   " << divergence->lamps << '\n';
+      return 2;
+    }
+    std::cout << result->numVectors << " vectors match\n";
+    return 0;
+  }
+
+  return -1;
 }
 
-// Run program: Ctrl + F5 or Debug > Start Without Debugging menu
-// Debug program: F5 or Debug > Start Debugging menu
+int main(int argc, char* argv[])
+{
+  const std::string_view mode = argc > 1 ? argv[1] : "--serve";
+
+  if (mode == "--serve" && argc <= 2)
+    return Serve(std::cin, std::cout);
+
+  if (mode == "--batch" && argc >= 5 && argc <= 7)
+  {
+    //Start positions and plugs are never numbers, so a trailing number is the thread count
+    std::vector<std::string_view> words{argv + 2, argv + argc};
+    const auto hasThreads = words.size() == 5 || (words.size() == 4 && ToNumber<size_t>(words.back()));
+    const auto numThreads = hasThreads ? ToNumber<size_t>(words.back()) : std::thread::hardware_concurrency();
+    if (hasThreads)
+      words.pop_back();
+    if (numThreads)
+      return Batch(words, *numThreads);
+  }
 
-// Tips for Getting Started: 
-//   1. Use the Solution Explorer window to add/manage files
-//   2. Use the Team Explorer window to connect to source control
-//   3. Use the Output window to see build output and other messages
-//   4. Use the Error List window to view errors
-//   5. Go to Project > Add New Item to create new code files, or Project > Add Existing Item to add existing code files to the project
-//   6. In the future, to open this project again, go to File > Open > Project and select the .sln file
+  if (const auto result = SearchJobCommand(mode, {argv + std::min(argc, 2), argv + argc}); result >= 0)
+    return result;
+
+  if (const auto result = TestVectorsCommand(mode, {argv + std::min(argc, 2), argv + argc}); result >= 0)
+    return result;
+
+  std::cerr << "usage: enigmaMain [--serve]\n"
+               "       enigmaMain --batch <wheels> <rings> [positions] <plugs> [threads]\n"
+               "       enigmaMain --search-create <dir> <plugs> <crib> <cipherText> [<shardSize> <topN>]\n"
+               "       enigmaMain --search-work <dir> <workerName> [staleSeconds]\n"
+               "       enigmaMain --search-merge <dir>\n"
+               "       enigmaMain --vectors-generate <file> <count> [<seed> [threads]]\n"
+               "       enigmaMain --vectors-verify <file> [reference|keystream]\n"
+               "  --serve   run jobs requested on stdin, e.g. from a pipe (default)\n"
+               "  --batch   encipher each line of stdin to stdout e.g. --batch 012 AAA AB,CD\n"
+               "  --search-create, --search-work, --search-merge\n"
+               "            crib search split into shards that any number of worker\n"
+               "            processes claim from dir; rerun a killed worker with the same\n"
+               "            name to resume it, then merge the best keys; a shard\n"
+               "            not checkpointed for staleSeconds (60) is taken over\n"
+               "  --vectors-generate, --vectors-verify\n"
+               "            random known answers from the reference machine, and the\n"
+               "            first one an engine gets wrong\n";
+  return 1;
+}
@@ -1,5 +1,25 @@
 #include "pch.h"
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <set>
+#include <sstream>
+#include <thread>
+#include "arena.h"
+#include "batch.h"
+#include "decipherBatch.h"
 #include "enigma.h"
+#include "jobService.h"
+#include "keystream.h"
+#include "metrics.h"
+#include "normalise.h"
+#include "offsetSearch.h"
+#include "search.h"
+#include "searchJob.h"
+#include "settings.h"
+#include "statistics.h"
+#include "testVectors.h"
 
 TEST(TestTextChar, Create)
 {
@@ -203,6 +223,9 @@ TEST(TestMachine, TestPlugBoard)
   EXPECT_FALSE(PlugBoard::Create({{*Key::Create('A'),*Key::Create('B')},
                                   {*Key::Create('A'),*Key::Create('L')},
                                   {*Key::Create('W'),*Key::Create('D')}})) << "Should detect duplicate Keys";
+  EXPECT_FALSE(PlugBoard::Create({{*Key::Create('A'),*Key::Create('B')},
+                                  {*Key::Create('A'),*Key::Create('B')}})) << "Should detect repeated plugs";
+  EXPECT_FALSE(PlugBoard::Create({{*Key::Create('A'),*Key::Create('A')}})) << "Should detect plugs to self";
 
   auto plugBoard = PlugBoard::Create({{*Key::Create('A'),*Key::Create('B')},
                                       {*Key::Create('E'),*Key::Create('L')},
@@ -218,3 +241,901 @@ TEST(TestMachine, TestPlugBoard)
   EXPECT_EQ("HELLOWORLD", m_.ToLamp("SOVVEDEIVW"));
 }
 
+TEST(TestMachine, PlugBoardSwap)
+{
+  const auto toString = [](const PlugBoard& plugBoard)
+  {
+    std::string text;
+    for (unsigned char key = 0; key != c_numChars; ++key)
+      text += plugBoard.Transform(Key{} + key).Value();
+    return text;
+  };
+
+  auto plugBoard = PlugBoard::Create();
+  struct
+  {
+    size_t line;
+    std::string msg;
+    char lhs;
+    char rhs; //Unswap lhs if ' '
+    bool expectedResult;
+    std::string expectedBoard;
+  } tests[] =
+  {
+    {__LINE__, "swap", 'A', 'Z', true, "ZBCDEFGHIJKLMNOPQRSTUVWXYA"},
+    {__LINE__, "second swap", 'C', 'B', true, "ZCBDEFGHIJKLMNOPQRSTUVWXYA"},
+    {__LINE__, "lhs plugged", 'A', 'D', false, "ZCBDEFGHIJKLMNOPQRSTUVWXYA"},
+    {__LINE__, "rhs plugged", 'D', 'B', false, "ZCBDEFGHIJKLMNOPQRSTUVWXYA"},
+    {__LINE__, "self", 'D', 'D', false, "ZCBDEFGHIJKLMNOPQRSTUVWXYA"},
+    {__LINE__, "unswap by partner", 'Z', ' ', true, "ACBDEFGHIJKLMNOPQRSTUVWXYZ"},
+    {__LINE__, "unswap unplugged", 'A', ' ', false, "ACBDEFGHIJKLMNOPQRSTUVWXYZ"},
+    {__LINE__, "swap freed key", 'A', 'D', true, "DCBAEFGHIJKLMNOPQRSTUVWXYZ"},
+  };
+  for (const auto& test: tests)
+  {
+    const auto lhs = *Key::Create(test.lhs);
+    const auto result = test.rhs == ' ' ? plugBoard.Unswap(lhs) : plugBoard.Swap(lhs, *Key::Create(test.rhs));
+    EXPECT_EQ(test.expectedResult, result) << "(" << test.line << ") " << test.msg;
+    EXPECT_EQ(test.expectedBoard, toString(plugBoard)) << "(" << test.line << ") " << test.msg;
+  }
+  EXPECT_TRUE(plugBoard.IsPlugged(*Key::Create('D')));
+  EXPECT_FALSE(plugBoard.IsPlugged(*Key::Create('Z')));
+
+  auto created = PlugBoard::Create({{*Key::Create('A'),*Key::Create('D')},
+                                    {*Key::Create('C'),*Key::Create('B')}});
+  ASSERT_TRUE(created);
+  EXPECT_EQ(toString(plugBoard), toString(*created));
+}
+
+TEST(TestSettings, ParseAndPrint)
+{
+  struct
+  {
+    size_t line;
+    std::string msg;
+    std::string settings;
+    bool valid;
+  } tests[] =
+  {
+    {__LINE__, "no plugs", "012 AAA -", true},
+    {__LINE__, "plugs", "420 QEV AB,CD,EF", true},
+    {__LINE__, "wheel out of range", "015 AAA -", false},
+    {__LINE__, "lower case ring setting", "012 aAA -", false},
+    {__LINE__, "half a plug", "012 AAA AB,C", false},
+    {__LINE__, "missing plugs", "012 AAA", false},
+  };
+  for (const auto& test: tests)
+  {
+    const auto settings = ParseSettings(test.settings);
+    EXPECT_EQ(test.valid, !!settings) << "(" << test.line << ") " << test.msg;
+    if (settings)
+      EXPECT_EQ(test.settings, ToString(*settings)) << "(" << test.line << ") " << test.msg;
+  }
+}
+
+TEST(TestSearch, FindsCribSettings)
+{
+  auto m = CreateStandardMachine();
+  const auto settings = ParseSettings("241 KQD AZ,BY");
+  ASSERT_TRUE(settings);
+  ASSERT_TRUE(Configure(m, *settings));
+
+  const auto cipherText = m.ToLamp("WETTERVORHERSAGE");
+  const std::atomic<bool> cancelled{false};
+  const auto hits = SearchCrib(CreateStandardMachine(), settings->plugs, "WETTERVORHERSAGE", cipherText, cancelled);
+
+  ASSERT_EQ(1u, hits.size());
+  EXPECT_EQ("241 KQD AZ,BY", ToString(hits.front()));
+}
+
+static JobStatus WaitFor(const JobService& service, JobId id)
+{
+  for (;;)
+  {
+    const auto status = service.Status(id);
+    if (!status)
+      throw std::runtime_error("unknown job");
+    if (status->state != JobState::Queued && status->state != JobState::Running)
+      return *status;
+    std::this_thread::sleep_for(std::chrono::milliseconds{1});
+  }
+}
+
+TEST(TestJobService, EncipherAndDecipher)
+{
+  JobService service{CreateStandardMachine(), 2};
+
+  const auto encipher = service.Handle("encipher 012 AAA AB,CD HELLOWORLD");
+  EXPECT_EQ("1 queued", encipher);
+  const auto cipherText = WaitFor(service, 1);
+  EXPECT_EQ(JobState::Done, cipherText.state);
+  EXPECT_EQ(10u, cipherText.result.size());
+
+  EXPECT_EQ("2 queued", service.Handle("decipher 012 AAA AB,CD " + cipherText.result));
+  EXPECT_EQ(JobState::Done, WaitFor(service, 2).state);
+  EXPECT_EQ("2 done HELLOWORLD", service.Handle("status 2"));
+
+  EXPECT_EQ("3 queued", service.Handle("encipher 012 AAA - hello"));
+  EXPECT_EQ(JobState::Failed, WaitFor(service, 3).state);
+
+  EXPECT_EQ("error bad settings", service.Handle("encipher 012 AAA A HELLO"));
+  EXPECT_EQ("error unknown job", service.Handle("status 99"));
+  EXPECT_EQ("error unknown request", service.Handle("launch"));
+}
+
+TEST(TestJobService, SearchModes)
+{
+  JobService service{CreateStandardMachine(), 2};
+
+  //Start positions other than AAA are only found searching offsets, which
+  //takes longer the more ways the rotors can step over the crib
+  const std::string crib = "OBERKOMM";
+  auto m = CreateStandardMachine();
+  ASSERT_TRUE(Configure(m, *ParseSettings("124 MCK XQT EN,IG,MA")));
+  const auto cipherText = m.ToLamp(crib);
+
+  EXPECT_EQ("1 queued", service.Handle("search EN,IG,MA " + crib + ' ' + cipherText + " rings"));
+  EXPECT_EQ(JobState::Done, WaitFor(service, 1).state);
+  EXPECT_EQ("1 done", service.Handle("status 1"));
+  EXPECT_EQ("2 queued", service.Handle("search EN,IG,MA " + crib + ' ' + cipherText + " offsets"));
+  const auto offsets = WaitFor(service, 2);
+  EXPECT_EQ(JobState::Done, offsets.state);
+  EXPECT_EQ(0u, offsets.result.find("124 ")) << offsets.result;
+  EXPECT_NE(std::string::npos, offsets.result.find(" EN,IG,MA x")) << offsets.result;
+
+  EXPECT_EQ("error unknown search mode", service.Handle("search - WETTER QWERTZ bombe"));
+}
+
+TEST(TestJobService, InteractiveNotBlockedBySearch)
+{
+  JobService service{CreateStandardMachine(), 2};
+
+  //Fill every unreserved thread with a long search
+  const auto search1 = service.Search({}, "WETTERVORHERSAGE", "ABCDEFGHIJKLMNOP");
+  const auto search2 = service.Search({}, "WETTERVORHERSAGE", "ABCDEFGHIJKLMNOP");
+
+  const auto encipher = service.Encipher(*ParseSettings("012 AAA -"), "HELLOWORLD");
+  EXPECT_EQ(JobState::Done, WaitFor(service, encipher).state);
+
+  EXPECT_TRUE(service.Cancel(search1));
+  EXPECT_TRUE(service.Cancel(search2));
+  EXPECT_EQ(JobState::Cancelled, WaitFor(service, search1).state);
+  EXPECT_EQ(JobState::Cancelled, WaitFor(service, search2).state);
+}
+
+TEST(TestJobService, KeepsLatestFinishedJobs)
+{
+  JobService service{CreateStandardMachine(), 2, 2};
+
+  for (JobId id = 1; id != 4; ++id)
+  {
+    EXPECT_EQ(std::to_string(id) + " queued", service.Handle("encipher 012 AAA - HELLOWORLD"));
+    EXPECT_EQ(JobState::Done, WaitFor(service, id).state);
+  }
+  EXPECT_EQ("error unknown job", service.Handle("status 1"));
+  EXPECT_TRUE(service.Status(2));
+  EXPECT_TRUE(service.Status(3));
+}
+
+TEST(TestJobService, DestructionCancelsJobs)
+{
+  //The destructor cancels as CancelAll does, then returns once the pool has
+  //drained the cancelled jobs
+  JobService service{CreateStandardMachine(), 2};
+  std::vector<JobId> ids;
+  for (size_t search = 0; search != 100; ++search)
+    ids.push_back(service.Search({}, "WETTERVORHERSAGE", "ABCDEFGHIJKLMNOP"));
+  service.CancelAll();
+
+  for (const auto id: ids)
+  {
+    const auto status = service.Status(id);
+    ASSERT_TRUE(status) << id;
+    EXPECT_NE(JobState::Queued, status->state) << id;
+    EXPECT_NE(JobState::Failed, status->state) << id;
+  }
+  //Behind all the other searches on the one Background thread
+  EXPECT_EQ(JobState::Cancelled, service.Status(ids.back())->state);
+}
+
+TEST(TestBatch, EncipherLinesInOrder)
+{
+  auto m = CreateStandardMachine();
+  ASSERT_TRUE(Configure(m, *ParseSettings("103 XYZ QW,ER")));
+
+  std::string keys;
+  std::string expectedLamps;
+  for (size_t line = 0; line != 5000; ++line)
+  {
+    std::string message(line % 37, 'A');
+    for (size_t i = 0; i != message.size(); ++i)
+      message[i] = static_cast<char>('A' + (line + i*i) % c_numChars);
+    keys += message + '\n';
+    expectedLamps += Machine{m}.ToLamp(message) + '\n';
+  }
+  keys += "not enigma text\r\n";
+  expectedLamps += "\n";
+
+  for (const size_t numThreads: {1, 3, 8})
+  {
+    std::istringstream in{keys};
+    std::ostringstream out;
+    EXPECT_EQ(5001u, EncipherLines(m, in, out, numThreads)) << numThreads << " threads";
+    EXPECT_EQ(expectedLamps, out.str()) << numThreads << " threads";
+  }
+}
+
+TEST(TestMetrics, CountsKeystrokesWhenEnabled)
+{
+  const auto before = TakeMetricsSnapshot().Total();
+
+  auto m = CreateStandardMachine();
+  ASSERT_TRUE(Configure(m, *ParseSettings("012 AAA AB")));
+  m.ToLamp("HELLOWORLD");
+
+  const auto after = TakeMetricsSnapshot();
+  const auto keystrokes = static_cast<size_t>(MetricCounter::Keystrokes);
+  const auto toLamp = static_cast<size_t>(MetricLatency::ToLamp);
+  EXPECT_EQ(MetricsEnabled() ? 10u : 0u, after.Total().counters[keystrokes] - before.counters[keystrokes]);
+  EXPECT_EQ(MetricsEnabled() ? 1u : 0u, after.Total().latencies[toLamp].count - before.latencies[toLamp].count);
+
+  const auto json = ToJson(after);
+  EXPECT_EQ(0u, json.find(MetricsEnabled() ? "{\"enabled\":true," : "{\"enabled\":false,"));
+  EXPECT_NE(std::string::npos, json.find("\"keystrokes\":"));
+
+  //Searches encipher a key at a time, so count their keystrokes in bulk
+  const std::atomic<bool> cancelled{false};
+  const auto plainKeys = *ToKeys("WETTER");
+  const auto cipherKeys = *ToKeys("QWERTZ");
+  TopKeys top{1};
+  const auto beforeScore = TakeMetricsSnapshot().Total();
+  EXPECT_EQ(2*c_numRingSettings, ScoreCrib(CreateStandardMachine(), *PlugBoard::Create({}), plainKeys, cipherKeys,
+                                           c_numRingSettings, 2*c_numRingSettings, top, cancelled));
+  const auto afterScore = TakeMetricsSnapshot().Total();
+  EXPECT_EQ(MetricsEnabled() ? c_numRingSettings*plainKeys.size() : 0u,
+            afterScore.counters[keystrokes] - beforeScore.counters[keystrokes]);
+
+  SearchCrib(CreateStandardMachine(), {}, "WETTER", "QWERTZ", cancelled);
+  const auto numSearchKeystrokes = TakeMetricsSnapshot().Total().counters[keystrokes] - afterScore.counters[keystrokes];
+  //At least one key a candidate, stopping at the first that doesn't match
+  EXPECT_GE(numSearchKeystrokes, MetricsEnabled() ? c_numScramblerKeys : 0u);
+  EXPECT_LT(numSearchKeystrokes, 2*c_numScramblerKeys);
+}
+
+TEST(TestEncipheredText, PackedFiveBitsALetter)
+{
+  EXPECT_EQ(5u, EncipheredText::c_bits);
+
+  std::vector<TextChar> letters;
+  EncipheredText text;
+  for (size_t i = 0; i != 1000; ++i)
+  {
+    letters.push_back(TextChar{} + static_cast<int>((i*7 + i/13) % c_numChars));
+    text.push_back(letters.back());
+  }
+  ASSERT_EQ(letters.size(), text.size());
+  text.shrink_to_fit();
+  EXPECT_LT(text.capacity(), letters.size() + 13); //Rounded up to a whole 64 bit word
+  for (size_t i = 0; i != letters.size(); ++i)
+    EXPECT_EQ(letters[i], text[i]) << i;
+  EXPECT_TRUE(std::equal(letters.cbegin(), letters.cend(), text.cbegin(), text.cend()));
+  EXPECT_EQ(EncipheredText(letters.cbegin(), letters.cend()), text);
+
+  //Letters straddling 64 bit words
+  text[12] = *TextChar::Create('Z');
+  text[13] = text[12];
+  EXPECT_EQ('Z', text[12].Value());
+  EXPECT_EQ('Z', text[13].Value());
+  EXPECT_EQ(letters[11], text[11]);
+  EXPECT_EQ(letters[14], text[14]);
+
+  auto shorter = text;
+  shorter.pop_back();
+  shorter.push_back(text.back());
+  EXPECT_EQ(text, shorter);
+  shorter.resize(3);
+  EXPECT_EQ(EncipheredText({text[0], text[1], text[2]}), shorter);
+}
+
+TEST(TestPreamble, CallsignsWithoutAllocation)
+{
+  using Callsigns = decltype(Preamble::to);
+  //Sizes, allocator and two callsigns or a pointer: no bigger than a vector, without its heap block
+  EXPECT_LE(sizeof(Callsigns), sizeof(std::vector<Callsign>));
+
+  const auto callsign = [](const char* letters)
+  {
+    return Callsign{*TextChar::Create(letters[0]), *TextChar::Create(letters[1]), *TextChar::Create(letters[2])};
+  };
+
+  EnigmaMessage message;
+  message.preamble.to.push_back(callsign("ABC"));
+  message.preamble.to.push_back(callsign("DEF"));
+  EXPECT_EQ(2u, message.preamble.to.capacity());
+  message.preamble.to.push_back(callsign("GHI"));
+  message.preamble.to.push_back(message.preamble.to.front());
+  EXPECT_EQ(4u, message.preamble.to.size());
+
+  const auto copy = message;
+  EXPECT_EQ(Callsigns({callsign("ABC"), callsign("DEF"), callsign("GHI"), callsign("ABC")}), copy.preamble.to);
+
+  auto moved = std::move(message);
+  EXPECT_EQ(copy.preamble.to, moved.preamble.to);
+  EXPECT_TRUE(message.preamble.to.empty());
+}
+
+TEST(TestArena, PlugBoardsAndMessages)
+{
+  Arena arena{1024};
+
+  for (size_t batch = 0; batch != 3; ++batch)
+  {
+    auto& plugs = arena.Create<Plugs>();
+    EXPECT_EQ(arena.Resource(), plugs.get_allocator().resource());
+    plugs.push_back({*Key::Create('A'), *Key::Create('B')});
+    plugs.push_back({*Key::Create('C'), *Key::Create('D')});
+
+    const auto plugBoard = arena.Create(PlugBoard::Create(plugs));
+    ASSERT_TRUE(plugBoard);
+    EXPECT_EQ('B', plugBoard->Transform(*Key::Create('A')).Value());
+    EXPECT_FALSE(arena.Create(PlugBoard::Create({{*Key::Create('A'), *Key::Create('B')},
+                                                 {*Key::Create('B'), *Key::Create('C')}})));
+
+    EnigmaMessage parsed;
+    for (size_t i = 0; i != 500; ++i)
+      parsed.encipheredText.push_back(TextChar{} + static_cast<int>(i));
+
+    auto& message = arena.Create<EnigmaMessage>(parsed);
+    EXPECT_EQ(arena.Resource(), message.encipheredText.get_allocator().resource());
+    EXPECT_EQ(parsed.encipheredText, message.encipheredText);
+
+    auto& empty = arena.Create<EnigmaMessage>();
+    EXPECT_EQ(arena.Resource(), empty.encipheredText.get_allocator().resource());
+    EXPECT_EQ(arena.Resource(), empty.preamble.to.get_allocator().resource());
+
+    //More recipients than fit inline
+    for (const auto letter: {'A', 'B', 'C', 'D'})
+      parsed.preamble.to.push_back(Callsign{*TextChar::Create(letter), *TextChar::Create(letter), *TextChar::Create(letter)});
+    auto& broadcast = arena.Create<EnigmaMessage>(parsed);
+    EXPECT_EQ(arena.Resource(), broadcast.preamble.to.get_allocator().resource());
+    EXPECT_EQ(parsed.preamble.to, broadcast.preamble.to);
+    broadcast.preamble.to.push_back(broadcast.preamble.to.front());
+    EXPECT_EQ(5u, broadcast.preamble.to.size());
+
+    arena.Release();
+  }
+}
+
+TEST(TestNormalise, Text)
+{
+  struct
+  {
+    size_t line;
+    std::string msg;
+    std::string text;
+    std::string expectedKeys;
+  } tests[] =
+  {
+    {__LINE__, "empty", "", ""},
+    {__LINE__, "capitals", "HELLOWORLD", "HELLOWORLD"},
+    {__LINE__, "lower case", "Hello World", "HELLOWORLD"},
+    {__LINE__, "full stop", "Ende.", "ENDEX"},
+    {__LINE__, "numbers", "um 17 Uhr", "UMEINSSIEBENUHR"},
+    {__LINE__, "punctuation", "a,b;c!'\"\t\n", "ABC"},
+    {__LINE__, "past a block", "Wetter fuer die Nacht: bedeckt, Wind aus 270.", "WETTERFUERDIENACHTBEDECKTWINDAUSZWOSIEBENNULLX"},
+    {__LINE__, "outside ascii", "\xc3\xa4\xc3\xb6\xc3\xbc plus ascii letters after", "PLUSASCIILETTERSAFTER"},
+    {__LINE__, "letter blocks", "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ@[`{", "ABCDEFGHIJKLMNOPQRSTUVWXYZABCDEFGHIJKLMNOPQRSTUVWXYZ"},
+  };
+  for (const auto& test: tests)
+  {
+    const auto normalised = Normalise(test.text);
+    EXPECT_EQ(test.expectedKeys, normalised.keys) << "(" << test.line << ") " << test.msg;
+  }
+
+  EXPECT_EQ("UMUHR", Normalise("um 17 Uhr.", {false, false}).keys);
+}
+
+TEST(TestNormalise, RestoreSeparators)
+{
+  const std::string cipherText = "QWERT ZUIOP\nASDFG HJKLY.XCVBN M";
+  const auto normalised = Normalise(cipherText, {false, false});
+  EXPECT_EQ("QWERTZUIOPASDFGHJKLYXCVBNM", normalised.keys);
+  EXPECT_EQ(cipherText, Restore(normalised.keys, normalised.dropped));
+
+  auto m = CreateStandardMachine();
+  auto m_ = m;
+  const auto enciphered = ToLampFormatted(m, "Angriff um 0600, Planquadrat 7. Ende");
+  EXPECT_EQ(',', enciphered[enciphered.find(',')]);
+  EXPECT_EQ(' ', enciphered[enciphered.size() - 5]);
+  EXPECT_EQ("ANGRIFF UM NULLSEQSNULLNULL, PLANQUADRAT SIEBENX ENDE", ToLampFormatted(m_, enciphered));
+}
+
+TEST(TestKeystream, SharedBetweenConsumers)
+{
+  auto m = CreateStandardMachine();
+  ASSERT_TRUE(Configure(m, *ParseSettings("342 RFW AQ,BP,CX")));
+
+  constexpr size_t windowSize = 8;
+  Keystream keystream{m, windowSize};
+  EXPECT_EQ(0u, keystream.Produced());
+
+  //Two candidate plaintexts walking the stream in step
+  const std::string plain1 = "ANGRIFFIMMORGENGRAUEN";
+  const std::string plain2 = "KEINEBESONDERENEREIGNISSE";
+  std::string cipher1;
+  std::string cipher2;
+  for (const auto& permutation: keystream.Positions(0, plain2.size()))
+  {
+    if (cipher1.size() != plain1.size())
+      cipher1 += permutation[Key::Create(plain1[cipher1.size()])->Index()].Value();
+    cipher2 += permutation[Key::Create(plain2[cipher2.size()])->Index()].Value();
+  }
+  EXPECT_EQ(plain2.size(), keystream.Produced());
+  EXPECT_EQ(Machine{m}.ToLamp(plain1), cipher1);
+  EXPECT_EQ(Machine{m}.ToLamp(plain2), cipher2);
+
+  //A third consumer starting again, from outside the window
+  EXPECT_EQ(0u, keystream.ReplaySteps());
+  EXPECT_EQ(Machine{m}.ToLamp(plain1), keystream.ToLamp(plain1));
+  EXPECT_EQ(plain2.size(), keystream.Produced());
+  EXPECT_EQ(plain2.size() - windowSize, keystream.ReplaySteps());
+
+  //A long replay steps the rotors once a position, not once a position per position
+  std::string longPlain(40000, 'A');
+  for (size_t i = 0; i != longPlain.size(); ++i)
+    longPlain[i] = static_cast<char>('A' + (i*i + 3*i) % c_numChars);
+  const auto longCipher = Machine{m}.ToLamp(longPlain);
+  EXPECT_EQ(longCipher, keystream.ToLamp(longPlain));
+  const auto replaySteps = keystream.ReplaySteps();
+  EXPECT_EQ(longCipher, keystream.ToLamp(longPlain));
+  EXPECT_EQ(longCipher.substr(100), keystream.ToLamp(std::string_view{longPlain}.substr(100), 100));
+  EXPECT_EQ(replaySteps + 2*(longPlain.size() - windowSize), keystream.ReplaySteps());
+
+  //Each position is a reciprocal permutation with no fixed points
+  const auto permutation = keystream.At(100);
+  for (size_t key = 0; key != c_numChars; ++key)
+  {
+    EXPECT_NE(key, permutation[key].Index());
+    EXPECT_EQ(key, permutation[permutation[key].Index()].Index());
+  }
+}
+
+TEST(TestSearchJob, ResumeAndMerge)
+{
+  const auto jobDir = std::filesystem::temp_directory_path()/"enigmaTestSearchJob";
+  std::filesystem::remove_all(jobDir);
+
+  auto m = CreateStandardMachine();
+  const auto settings = ParseSettings("320 BAD PL,UG");
+  ASSERT_TRUE(Configure(m, *settings));
+
+  SearchJob job;
+  job.plugs = settings->plugs;
+  job.crib = "WETTERBERICHT";
+  job.cipherText = m.ToLamp(job.crib);
+  job.shardSize = c_numScramblerKeys/8 + 1;
+  job.topN = 3;
+  ASSERT_TRUE(CreateSearchJob(jobDir, job));
+  EXPECT_FALSE(CreateSearchJob(jobDir, job)) << "Already exists";
+
+  const auto loaded = LoadSearchJob(jobDir);
+  ASSERT_TRUE(loaded);
+  EXPECT_EQ(job.cipherText, loaded->cipherText);
+  EXPECT_EQ(8u, loaded->NumShards());
+
+  //A worker killed part way through shard 2
+  std::filesystem::create_directories(jobDir/"shard-2.claim");
+  std::ofstream{jobDir/"shard-2.claim"/"owner"} << "a";
+  std::ofstream{jobDir/"shard-2.claim"/"checkpoint"} << "next " << 2*job.shardSize + 100 << "\n";
+
+  const std::atomic<bool> cancelled{false};
+  EXPECT_EQ(0u, MergeSearchJob(jobDir)->numDone);
+  EXPECT_EQ(8u, RunSearchWorker(CreateStandardMachine(), jobDir, "a", cancelled, 50000));
+  EXPECT_EQ(0u, RunSearchWorker(CreateStandardMachine(), jobDir, "b", cancelled)) << "Nothing left to do";
+
+  const auto result = MergeSearchJob(jobDir);
+  ASSERT_TRUE(result);
+  EXPECT_EQ(8u, result->numDone);
+  ASSERT_EQ(3u, result->top.size());
+  EXPECT_EQ(job.crib.size(), result->top.front().score);
+  EXPECT_EQ("320 BAD PL,UG", ToString(MachineSettings{ToSelections(result->top.front().scramblerKey), job.plugs}));
+  EXPECT_GT(job.crib.size(), result->top[1].score);
+
+  std::filesystem::remove_all(jobDir);
+}
+
+TEST(TestSearchJob, TakeOverStaleClaim)
+{
+  const auto jobDir = std::filesystem::temp_directory_path()/"enigmaTestSearchJobStale";
+  std::filesystem::remove_all(jobDir);
+
+  SearchJob job;
+  job.crib = "WETTERBERICHT";
+  job.cipherText = "QJZKDNEBWMRLU";
+  job.shardSize = c_numScramblerKeys/4 + 1;
+  ASSERT_TRUE(CreateSearchJob(jobDir, job));
+
+  const auto claim = [&](size_t shard, std::string_view owner, std::chrono::hours age)
+  {
+    const auto claimDir = jobDir/("shard-" + std::to_string(shard) + ".claim");
+    std::filesystem::create_directories(claimDir);
+    std::ofstream{claimDir/"owner"} << owner;
+    std::ofstream{claimDir/"checkpoint"} << "next " << shard*job.shardSize + 100 << "\n";
+    const auto time = std::filesystem::file_time_type::clock::now() - age;
+    std::filesystem::last_write_time(claimDir/"owner", time);
+    std::filesystem::last_write_time(claimDir/"checkpoint", time);
+  };
+  claim(1, "dead", std::chrono::hours{1});
+  claim(3, "alive", std::chrono::hours{0});
+
+  const std::atomic<bool> cancelled{false};
+  EXPECT_EQ(3u, RunSearchWorker(CreateStandardMachine(), jobDir, "b", cancelled, 50000, std::chrono::seconds{60}));
+  EXPECT_FALSE(std::filesystem::exists(jobDir/"shard-1.claim"));
+  EXPECT_TRUE(std::filesystem::exists(jobDir/"shard-3.claim")) << "Still checkpointing";
+  EXPECT_EQ(3u, MergeSearchJob(jobDir)->numDone);
+
+  std::filesystem::remove_all(jobDir);
+}
+
+TEST(TestMachine, StandardWheelsKnownAnswers)
+{
+  struct
+  {
+    size_t line;
+    std::string msg;
+    std::string settings;
+    std::string keys;
+    std::string expectedLamps;
+  } tests[] =
+  {
+    {__LINE__, "start", "012 AAA -", "AAAAA", "BDZGO"},
+    {__LINE__, "ring settings", "012 BBB -", "AAAAA", "EWTYX"},
+    {__LINE__, "double step", "012 AAA ADU -", "AAAAA", "EQIBM"},
+  };
+  for (const auto& test: tests)
+  {
+    auto m = CreateStandardMachine();
+    ASSERT_TRUE(Configure(m, *ParseSettings(test.settings))) << "(" << test.line << ") " << test.msg;
+    EXPECT_EQ(test.expectedLamps, m.ToLamp(test.keys)) << "(" << test.line << ") " << test.msg;
+  }
+
+  //Stepping from ADU: the right rotor turns the middle over at V, which
+  //then steps itself and the left rotor at E
+  auto m = CreateStandardMachine();
+  ASSERT_TRUE(Configure(m, *ParseSettings("012 AAA ADU -")));
+  std::string positions;
+  for (size_t key = 0; key != 4; ++key)
+  {
+    m.Step();
+    for (const auto position: m.Positions())
+      positions += position.Value();
+    positions += ' ';
+  }
+  EXPECT_EQ("ADV AEW BFX BFY ", positions);
+}
+
+TEST(TestOffsetSearch, EquivalentKeys)
+{
+  const auto settings = ParseSettings("124 MCK XQT EN,IG,MA");
+  ASSERT_TRUE(settings);
+  auto m = CreateStandardMachine();
+  ASSERT_TRUE(Configure(m, *settings));
+  const std::string crib = "OBERKOMMANDO";
+  const auto cipherText = m.ToLamp(crib);
+
+  const WheelOrder wheelOrder{settings->selections[0].wheelIndex,
+                              settings->selections[1].wheelIndex,
+                              settings->selections[2].wheelIndex};
+  const auto classes = StepClasses(m, wheelOrder, crib.size());
+  EXPECT_LT(10*classes.size(), c_numChars*c_numChars);
+  size_t numPositions = 0;
+  for (const auto& stepClass: classes)
+    numPositions += stepClass.size();
+  EXPECT_EQ(c_numChars*c_numChars, numPositions);
+
+  const std::atomic<bool> cancelled{false};
+  const auto hits = SearchCribByOffset(CreateStandardMachine(), wheelOrder, settings->plugs, crib, cipherText, cancelled);
+  ASSERT_FALSE(hits.empty());
+
+  size_t numFound = 0;
+  for (const auto& hit: hits)
+  {
+    const auto keys = hit.Expand();
+    EXPECT_EQ(hit.Count(), keys.size());
+    for (const auto& selections: keys)
+    {
+      if (ToString(MachineSettings{selections, settings->plugs}) == ToString(*settings))
+        ++numFound;
+    }
+
+    //A sample of the equivalent keys all give the same cipher text
+    for (size_t key = 0; key < keys.size(); key += 97)
+    {
+      auto equivalent = CreateStandardMachine();
+      ASSERT_TRUE(Configure(equivalent, MachineSettings{keys[key], settings->plugs}));
+      EXPECT_EQ(cipherText, equivalent.ToLamp(crib));
+    }
+  }
+  EXPECT_EQ(1u, numFound);
+
+  //Each keystream once, whichever class its keys came from
+  const auto toKeystream = [&](const std::array<WheelSelection, numScramblerRotors>& selections)
+  {
+    auto equivalent = CreateStandardMachine();
+    Configure(equivalent, MachineSettings{selections, {}});
+    Keystream keystream{equivalent};
+    std::string permutations;
+    for (const auto& permutation: keystream.Positions(0, crib.size()))
+      for (const auto lamp: permutation)
+        permutations += lamp.Value();
+    return permutations;
+  };
+  std::set<std::string> keystreams;
+  size_t numClasses = 0;
+  for (const auto& hit: hits)
+  {
+    const auto keystream = toKeystream(hit.Expand().front());
+    EXPECT_TRUE(keystreams.insert(keystream).second) << ToString(hit, settings->plugs);
+    for (const auto& keys: hit.classes)
+      EXPECT_EQ(keystream, toKeystream(EquivalentKeys{wheelOrder, {keys}}.Expand().back())) << ToString(hit, settings->plugs);
+    numClasses += hit.classes.size();
+  }
+  EXPECT_LT(hits.size(), numClasses) << "Middle rotor starting at its turnover";
+  EXPECT_EQ(ToString(MachineSettings{hits.front().Expand().front(), settings->plugs}) + " x" + std::to_string(hits.front().Count()),
+            ToString(hits.front(), settings->plugs));
+}
+
+TEST(TestVectors, GenerateAndVerify)
+{
+  constexpr size_t numVectors = 5000;
+  constexpr uint64_t seed = 1939;
+
+  std::ostringstream oneThread;
+  ASSERT_TRUE(WriteTestVectors(oneThread, seed, numVectors, 1));
+  std::ostringstream threads;
+  ASSERT_TRUE(WriteTestVectors(threads, seed, numVectors, 3));
+  const auto file = threads.str();
+  EXPECT_EQ(oneThread.str(), file);
+
+  const auto vector = GenerateTestVector(seed, 42);
+  auto m = CreateStandardMachine();
+  ASSERT_TRUE(Configure(m, vector.settings));
+  EXPECT_EQ(vector.lamps, m.ToLamp(vector.keys));
+
+  struct
+  {
+    size_t line;
+    std::string msg;
+    Engine engine;
+    std::optional<size_t> divergence;
+  } tests[] =
+  {
+    {__LINE__, "reference", ReferenceEngine(), {}},
+    {__LINE__, "keystream", [standardMachine = CreateStandardMachine()](const MachineSettings& settings, std::string_view keys)
+    {
+      auto m = standardMachine;
+      Configure(m, settings);
+      return Keystream{m}.ToLamp(keys);
+    }, {}},
+    {__LINE__, "broken", [reference = ReferenceEngine(), numCalls = size_t{0}](const MachineSettings& settings, std::string_view keys) mutable
+    {
+      auto lamps = reference(settings, keys);
+      if (numCalls++ == 1234)
+        lamps.back() = lamps.back() == 'A' ? 'B' : 'A';
+      return lamps;
+    }, 1234},
+  };
+  for (auto& test: tests)
+  {
+    std::istringstream in{file};
+    const auto result = VerifyTestVectors(in, test.engine);
+    ASSERT_TRUE(result) << "(" << test.line << ") " << test.msg;
+    EXPECT_EQ(test.divergence.has_value(), result->divergence.has_value()) << "(" << test.line << ") " << test.msg;
+    if (test.divergence && result->divergence)
+    {
+      EXPECT_EQ(*test.divergence + 1, result->numVectors) << "(" << test.line << ") " << test.msg;
+      EXPECT_EQ(*test.divergence, result->divergence->vector) << "(" << test.line << ") " << test.msg;
+      EXPECT_EQ(result->divergence->expected.lamps.size() - 1, result->divergence->position) << "(" << test.line << ") " << test.msg;
+    }
+    else
+      EXPECT_EQ(numVectors, result->numVectors) << "(" << test.line << ") " << test.msg;
+  }
+
+  std::istringstream truncated{file.substr(0, file.size() - 1)};
+  EXPECT_FALSE(VerifyTestVectors(truncated, ReferenceEngine()));
+  std::istringstream notVectors{"ENIGMA"};
+  EXPECT_FALSE(VerifyTestVectors(notVectors, ReferenceEngine()));
+}
+
+TEST(TestVectors, IndependentStreams)
+{
+  //Keys are drawn last, so if the stream of a vector were the previous
+  //vector's shifted by a draw its keys would be the previous keys shifted by a letter
+  for (const uint64_t seed: {uint64_t{0}, uint64_t{1939}})
+  {
+    size_t numShifted = 0;
+    auto previous = GenerateTestVector(seed, 0);
+    for (size_t index = 1; index != 200; ++index)
+    {
+      auto vector = GenerateTestVector(seed, index);
+      const auto overlap = std::min(vector.keys.size(), previous.keys.size() - 1);
+      if (overlap >= 8 && vector.keys.compare(0, overlap, previous.keys, 1, overlap) == 0)
+        ++numShifted;
+      previous = std::move(vector);
+    }
+    EXPECT_EQ(0u, numShifted) << "seed " << seed;
+  }
+}
+
+TEST(TestDecipherBatch, MatchesMachine)
+{
+  //Random settings and messages, from the test vectors
+  std::vector<std::string> messages;
+  std::vector<DecipherItem> items;
+  for (size_t message = 0; message != 20; ++message)
+    messages.push_back(GenerateTestVector(7, message).keys);
+  messages.push_back("NOT ALL LETTERS");
+
+  //Many plugs for one setting, so deciphered through a keystream
+  const auto shared = GenerateTestVector(8, 0).settings;
+  for (size_t item = 0; item != 200; ++item)
+    items.push_back({item % messages.size(), MachineSettings{shared.selections, GenerateTestVector(9, item).settings.plugs}});
+  //Settings of their own, deciphered directly
+  for (size_t item = 0; item != 50; ++item)
+    items.push_back({item % messages.size(), GenerateTestVector(10, item).settings});
+  items.push_back({0, MachineSettings{shared.selections, *ParsePlugs("AB,AC")}});
+  items.push_back({1, MachineSettings{shared.selections, *ParsePlugs("AB")}});
+
+  PriorityThreadPool pool{3};
+  const auto standardMachine = CreateStandardMachine();
+  const auto lamps = DecipherBatch(standardMachine, messages, items, pool);
+  ASSERT_EQ(items.size(), lamps.size());
+  for (size_t item = 0; item != items.size(); ++item)
+  {
+    auto m = standardMachine;
+    std::string expected;
+    if (Configure(m, items[item].key))
+      m.ToLamp(messages[items[item].message], expected);
+    EXPECT_EQ(expected, lamps[item]) << "(" << item << ") " << ToString(items[item].key);
+  }
+  EXPECT_TRUE(lamps[items.size() - 2].empty()) << "A plugged twice";
+  EXPECT_FALSE(lamps[items.size() - 1].empty());
+}
+
+TEST(TestDecipherBatch, FromPoolTask)
+{
+  //The pool's only Batch thread runs the caller, so the caller has to do the groups
+  PriorityThreadPool pool{2};
+  const auto standardMachine = CreateStandardMachine();
+  const std::vector<std::string> messages{"HELLOWORLD"};
+  std::vector<DecipherItem> items;
+  for (size_t item = 0; item != 10; ++item)
+    items.push_back({0, GenerateTestVector(11, item).settings});
+
+  std::promise<std::vector<std::string>> lamps;
+  auto future = lamps.get_future();
+  pool.Submit(Priority::Batch, [&]{ lamps.set_value(DecipherBatch(standardMachine, messages, items, pool)); });
+  ASSERT_EQ(std::future_status::ready, future.wait_for(std::chrono::seconds{10}));
+  const auto result = future.get();
+  ASSERT_EQ(items.size(), result.size());
+  for (size_t item = 0; item != items.size(); ++item)
+  {
+    auto m = standardMachine;
+    std::string expected;
+    Configure(m, items[item].key);
+    m.ToLamp(messages[0], expected);
+    EXPECT_EQ(expected, result[item]) << "(" << item << ") " << ToString(items[item].key);
+  }
+}
+
+TEST(TestStatistics, Counts)
+{
+  const auto toText = [](std::string_view letters)
+  {
+    EncipheredText text;
+    for (const auto letter: letters)
+      text.push_back(*TextChar::Create(letter));
+    return text;
+  };
+
+  struct
+  {
+    size_t line;
+    std::string msg;
+    std::string text;
+  } tests[] =
+  {
+    {__LINE__, "empty", ""},
+    {__LINE__, "short", "ABBA"},
+    {__LINE__, "whole blocks", "DASOBERKOMMANDODERWEHRMACHTGIBTBEKANNTXX"},
+    {__LINE__, "separators", "AN OBERKOMMANDO. WETTERBERICHT 0600 UHR: REGEN, WIND aus NW"},
+    {__LINE__, "repeats", std::string(100, 'E') + "X" + std::string(37, 'E')},
+  };
+  for (const auto& test: tests)
+  {
+    LetterCounts expectedLetters{};
+    BigramCounts expectedBigrams{};
+    std::string letters;
+    for (size_t i = 0; i != test.text.size(); ++i)
+    {
+      const auto c = test.text[i];
+      if (c < 'A' || c > 'Z')
+        continue;
+      letters += c;
+      ++expectedLetters[c - 'A'];
+      if (i && test.text[i - 1] >= 'A' && test.text[i - 1] <= 'Z')
+        ++expectedBigrams[(test.text[i - 1] - 'A')*c_numChars + (c - 'A')];
+    }
+
+    EXPECT_EQ(expectedLetters, CountLetters(test.text)) << "(" << test.line << ") " << test.msg;
+    EXPECT_EQ(expectedBigrams, CountBigrams(test.text)) << "(" << test.line << ") " << test.msg;
+    EXPECT_EQ(CountLetters(letters), CountLetters(toText(letters))) << "(" << test.line << ") " << test.msg;
+    EXPECT_EQ(CountBigrams(letters), CountBigrams(toText(letters))) << "(" << test.line << ") " << test.msg;
+  }
+
+  const auto& german = GermanLanguageModel();
+  EXPECT_EQ(0.0, ChiSquared(CountLetters(""), german));
+  const std::string plain = "DASOBERKOMMANDODERWEHRMACHTGIBTBEKANNTXWETTERBERICHTFUERDIENORDSEE";
+  auto m = CreateStandardMachine();
+  const auto cipher = m.ToLamp(plain);
+  EXPECT_LT(ChiSquared(CountLetters(plain), german), ChiSquared(CountLetters(cipher), german));
+}
+
+TEST(TestStatistics, AggregateTraffic)
+{
+  const auto callsign = [](std::string_view letters)
+  {
+    return Callsign{*TextChar::Create(letters[0]), *TextChar::Create(letters[1]), *TextChar::Create(letters[2])};
+  };
+  const std::array<std::pair<Callsign, Discriminant>, 3> stations =
+  {{
+    {callsign("ABC"), callsign("RED")},
+    {callsign("ABC"), callsign("OWL")},
+    {callsign("XYZ"), callsign("RED")},
+  }};
+
+  std::vector<EnigmaMessage> messages(500);
+  for (size_t message = 0; message != messages.size(); ++message)
+  {
+    messages[message].preamble.from = stations[message % stations.size()].first;
+    messages[message].preamble.discriminant = stations[message % stations.size()].second;
+    for (const auto letter: GenerateTestVector(11, message).lamps)
+      messages[message].encipheredText.push_back(*TextChar::Create(letter));
+  }
+
+  const auto traffic = AggregateTraffic(messages, 1);
+  ASSERT_EQ(stations.size(), traffic.size());
+  for (const auto& [from, discriminant]: stations)
+  {
+    TrafficStatistics expected;
+    for (const auto& message: messages)
+      if (message.preamble.from == from && message.preamble.discriminant == discriminant)
+      {
+        ++expected.numMessages;
+        std::string letters;
+        for (const auto letter: message.encipheredText)
+          letters += letter.Value();
+        const auto letterCounts = CountLetters(letters);
+        const auto bigramCounts = CountBigrams(letters);
+        std::transform(letterCounts.cbegin(), letterCounts.cend(), expected.letters.cbegin(), expected.letters.begin(), std::plus{});
+        std::transform(bigramCounts.cbegin(), bigramCounts.cend(), expected.bigrams.cbegin(), expected.bigrams.begin(), std::plus{});
+      }
+
+    const auto station = traffic.find(TrafficKey{from, discriminant});
+    ASSERT_NE(traffic.end(), station);
+    EXPECT_EQ(expected.numMessages, station->second.numMessages);
+    EXPECT_EQ(expected.letters, station->second.letters);
+    EXPECT_EQ(expected.bigrams, station->second.bigrams);
+  }
+
+  const auto threaded = AggregateTraffic(messages, 3);
+  ASSERT_EQ(traffic.size(), threaded.size());
+  for (const auto& [key, statistics]: traffic)
+  {
+    const auto& other = threaded.at(key);
+    EXPECT_EQ(statistics.numMessages, other.numMessages);
+    EXPECT_EQ(statistics.letters, other.letters);
+    EXPECT_EQ(statistics.bigrams, other.bigrams);
+  }
+  EXPECT_TRUE(AggregateTraffic({}, 4).empty());
+}